@@ -4,14 +4,13 @@
 
 #include <utility>
 
+#include "csprng.hpp"
+
+// Uniform in [0, 2^61 - 2], from the calling thread's CSPRNG
 inline uint64_t random_uint64() {
-    static std::mt19937_64 rng(std::random_device{}());
-    static std::uniform_int_distribution<uint64_t> dist(0, (1ULL << 61) - 2);
-    return dist(rng);
+    return csprng().uniform((1ULL << 61) - 1);
 }
 
 inline uint32_t random_uint32() {
-    static std::mt19937 rng(std::random_device{}());
-    static std::uniform_int_distribution<uint32_t> dist(0, 0xFFFFFFFF);
-    return dist(rng);
+    return csprng().next_u32();
 }
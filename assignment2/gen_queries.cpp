@@ -1,5 +1,3 @@
-#include <openssl/evp.h>
-#include <openssl/rand.h>
 #include <cstring>
 #include <iostream>
 #include <random>
@@ -10,71 +8,92 @@
 #include <cassert>
 #include <cmath>
 #include <unordered_set>
+#include <chrono>
+#include <memory>
+#include <mutex>
 
+#include "csprng.hpp"
+#include "gf128.hpp"
+#include "keyfile.hpp"
+#include "prg.hpp"
+#include "thread_pool.hpp"
 
-using uint128_t = __uint128_t;
 using namespace std;
 
 
-struct DPFLevel {
-    uint128_t scw;   
-    bool tL_cw;      
-    bool tR_cw;      
-    bool keep_is_left; 
-};
-
-struct DPFKey {
-    uint128_t root_seed;
-    bool root_flag;
-    vector<DPFLevel> levels;
-    uint128_t final_cw;
-};
+static int log2_floor(size_t n) {
+    int r = 0;
+    while (n > 1) { n >>= 1; ++r; }
+    return r;
+}
 
-struct PRGSingle {
-    uint128_t s;
-    bool t;
-};
+// Early termination: with out_bits < 128 each leaf seed holds 128/out_bits
+// consecutive outputs, so the tree stops log2(128/out_bits) levels early.
+template <class Key>
+static int leaf_shift(const Key& key) {
+    return log2_floor(128 / key.out_bits);
+}
 
+static uint128_t output_mask(uint32_t out_bits) {
+    return out_bits == 128 ? ~(uint128_t)0 : (((uint128_t)1 << out_bits) - 1);
+}
 
+// Output for domain point x out of the leaf word that holds it
+template <class Key>
+static uint128_t unpack_output(const Key& key, uint128_t leaf, uint64_t x) {
+    if (key.out_bits == 128) return leaf;
+    size_t slot = x & ((size_t(1) << leaf_shift(key)) - 1);
+    return (leaf >> (slot * key.out_bits)) & output_mask(key.out_bits);
+}
 
-inline array<unsigned char,16> u128_to_bytes_be(uint128_t x) {
-    array<unsigned char,16> b;
-    for (int i = 15; i >= 0; --i) {
-        b[i] = static_cast<unsigned char>(x & 0xFFu);
-        x >>= 8;
+// Wire size of a key. Tree: root seed and flag, per level a seed correction
+// word plus one byte for the two control-bit corrections, final CW, out_bits.
+// Sqrt: row seeds, packed row control bits, column CWs, out_bits.
+static size_t key_size_bytes(const DPFKey& key) {
+    if (key.kind == DPFKind::Sqrt) {
+        return key.row_seeds.size() * 16 + (key.row_seeds.size() + 7) / 8 + key.col_cw.size() * 16 + 1;
     }
-    return b;
+    return 16 + 1 + key.levels.size() * (16 + 1) + 16 + 1;
+}
+
+// The square-root key behind key, or nullptr for a tree key. Key file views
+// only ever hold tree keys.
+static const DPFKey* as_sqrt(const DPFKey& key) {
+    return key.kind == DPFKind::Sqrt ? &key : nullptr;
+}
+static const DPFKey* as_sqrt(const DPFKeyView&) {
+    return nullptr;
+}
+
+// log2 of the number of leaf words the key covers
+template <class Key>
+static size_t key_depth(const Key& key) {
+    if (const DPFKey* sq = as_sqrt(key)) return log2_floor(sq->row_seeds.size() * sq->col_cw.size());
+    return key.levels.size();
 }
 
-inline uint128_t bytes_be_to_u128(const unsigned char *buf) {
-    uint128_t x = 0;
-    for (int i = 0; i < 16; ++i) {
-        x <<= 8;
-        x |= static_cast<uint128_t>(buf[i]);
+// Number of leaf words covering dpf_size points; checks that it matches the key
+template <class Key>
+static size_t leaf_count(const Key& key, size_t dpf_size) {
+    int depth = max(0, log2_floor(dpf_size) - leaf_shift(key));
+    if ((dpf_size & (dpf_size - 1)) != 0 || (size_t)depth != key_depth(key)) {
+        throw invalid_argument("dpf_size does not match key depth");
     }
-    return x;
+    return size_t(1) << depth;
+}
+
+// Helpers: cryptographically secure randomness from the calling thread's
+// AES-CTR generator (csprng.hpp)
+static void secure_rand_bytes(unsigned char* out, size_t n) {
+    csprng().fill_bytes(out, n);
 }
 
-// Helper: generate a cryptographically secure 128-bit random value
 static uint128_t secure_rand128() {
-    unsigned char buf[16];
-    if (1 != RAND_bytes(buf, sizeof(buf))) {
-        throw runtime_error("RAND_bytes failed");
-    }
-    return bytes_be_to_u128(buf);
+    return csprng().next<uint128_t>();
 }
 
-// Helper: generate a cryptographically secure 64-bit random value
 static uint64_t secure_rand64() {
-    unsigned char buf[8];
-    if (1 != RAND_bytes(buf, sizeof(buf))) {
-        throw runtime_error("RAND_bytes failed");
-    }
-    uint64_t x = 0;
-    for (int i = 0; i < 8; ++i) {
-        x = (x << 8) | buf[i];
-    }
-    return x;
+    return csprng().next_u64();
 }
 
 string uint128_to_string(uint128_t n) {
@@ -91,47 +110,114 @@ string uint128_to_string(uint128_t n) {
 
 
 
-// PRG expansion following slides: PRG(seed || bit) -> child seed and bit
-static PRGSingle prg_expand_bit(uint128_t seed, unsigned char bit) {
-    array<unsigned char,17> in;
-    auto sbytes = u128_to_bytes_be(seed);
-    copy(sbytes.begin(), sbytes.end(), in.begin());
-    in[16] = bit; // domain separation by bit (0=left,1=right)
+// ---------------------------------------------------------------------------
+// Square-root DPF. The 2^d leaf words form a grid of 2^floor(d/2) rows by
+// 2^ceil(d/2) columns. The parties hold the same seed and control bit for
+// every row except the target row, where the seeds are independent and the
+// control bits differ. Row i expands to G(s_i)[0..cols) and, where its control
+// bit is set, is XORed with the column correction words
+// col_cw = G(s0) ^ G(s1) ^ word * e_col, so every row but the target cancels.
+// Keys are O(sqrt(N)) but a point costs one PRG call and a full domain has no
+// dependency chain longer than a row.
+// ---------------------------------------------------------------------------
 
-    unsigned char digest[32];
-    unsigned int digest_len = 0;
+// Column c of G(s): the PRG over the independent blocks s ^ m, with L giving
+// column 2m and R column 2m+1
+static uint128_t sqrt_row_word(uint128_t s, size_t col) {
+    PRGSingle L, R;
+    prg_expand(s ^ (uint128_t)(col >> 1), L, R);
+    return (col & 1) ? R.s : L.s;
+}
 
-    EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
-    if (mdctx == nullptr) throw runtime_error("EVP_MD_CTX_new failed");
-    if (1 != EVP_DigestInit_ex(mdctx, EVP_sha256(), NULL)) {
-        EVP_MD_CTX_free(mdctx);
-        throw runtime_error("EVP_DigestInit_ex failed");
+// G(s)[0..cols) into out
+static void sqrt_expand_row(uint128_t s, size_t cols, uint128_t* out) {
+    constexpr size_t B = 32;
+    uint128_t x[B], l[B], r[B];
+    size_t pairs = (cols + 1) / 2;
+    for (size_t m0 = 0; m0 < pairs; m0 += B) {
+        size_t n = min(B, pairs - m0);
+        for (size_t q = 0; q < n; ++q) x[q] = s ^ (uint128_t)(m0 + q);
+        prg_expand_many(x, n, l, r);
+        for (size_t q = 0; q < n; ++q) {
+            size_t c = 2 * (m0 + q);
+            out[c] = l[q];
+            if (c + 1 < cols) out[c + 1] = r[q];
+        }
     }
-    if (1 != EVP_DigestUpdate(mdctx, in.data(), in.size())) {
-        EVP_MD_CTX_free(mdctx);
-        throw runtime_error("EVP_DigestUpdate failed");
+}
+
+static pair<DPFKey, DPFKey> generateSqrtDPF(int depth, uint64_t leaf, uint128_t word, uint32_t out_bits) {
+    int row_bits = depth / 2;
+    int col_bits = depth - row_bits;
+    size_t rows = size_t(1) << row_bits, cols = size_t(1) << col_bits;
+    size_t row = leaf >> col_bits, col = leaf & (cols - 1);
+
+    DPFKey k0, k1;
+    for (DPFKey* k : {&k0, &k1}) {
+        k->kind = DPFKind::Sqrt;
+        k->out_bits = out_bits;
+        k->root_seed = 0;
+        k->root_flag = 0;
+        k->final_cw = 0;
     }
-    if (1 != EVP_DigestFinal_ex(mdctx, digest, &digest_len)) {
-        EVP_MD_CTX_free(mdctx);
-        throw runtime_error("EVP_DigestFinal_ex failed");
+    k0.row_seeds.resize(rows);
+    k0.row_flags.resize(rows);
+    secure_rand_bytes(reinterpret_cast<unsigned char*>(k0.row_seeds.data()), rows * sizeof(uint128_t));
+    secure_rand_bytes(k0.row_flags.data(), rows);
+    for (auto& f : k0.row_flags) f &= 1u;
+    k1.row_seeds = k0.row_seeds;
+    k1.row_flags = k0.row_flags;
+    k1.row_seeds[row] = secure_rand128();
+    k1.row_flags[row] ^= 1u;
+
+    vector<uint128_t> g1(cols);
+    k0.col_cw.resize(cols);
+    sqrt_expand_row(k0.row_seeds[row], cols, k0.col_cw.data());
+    sqrt_expand_row(k1.row_seeds[row], cols, g1.data());
+    for (size_t c = 0; c < cols; ++c) k0.col_cw[c] ^= g1[c];
+    k0.col_cw[col] ^= word;
+    k1.col_cw = k0.col_cw;
+    return {k0, k1};
+}
+
+static uint128_t evalSqrtLeaf(const DPFKey& key, uint64_t leaf) {
+    size_t cols = key.col_cw.size();
+    size_t row = leaf / cols, col = leaf & (cols - 1);
+    uint128_t w = sqrt_row_word(key.row_seeds[row], col);
+    return key.row_flags[row] ? w ^ key.col_cw[col] : w;
+}
+
+// Leaf words of grid row i into out[0..cols)
+static void evalSqrtRow(const DPFKey& key, size_t i, uint128_t* out) {
+    size_t cols = key.col_cw.size();
+    sqrt_expand_row(key.row_seeds[i], cols, out);
+    if (key.row_flags[i]) {
+        for (size_t c = 0; c < cols; ++c) out[c] ^= key.col_cw[c];
     }
-    EVP_MD_CTX_free(mdctx);
+}
 
-    PRGSingle out;
-    out.s = bytes_be_to_u128(digest);
-    out.t = static_cast<bool>(out.s & 1u);
-    return out;
+// Leaf words of rows [r0, r1) into out[r0*cols ..)
+static void evalSqrtRows(const DPFKey& key, size_t r0, size_t r1, uint128_t* out) {
+    for (size_t i = r0; i < r1; ++i) evalSqrtRow(key, i, out + i * key.col_cw.size());
 }
 
-pair<DPFKey, DPFKey> generateDPF(size_t dpf_size, uint64_t location, uint128_t value) {
+pair<DPFKey, DPFKey> generateDPF(size_t dpf_size, uint64_t location, uint128_t value, uint32_t out_bits = 128,
+                                 DPFKind kind = DPFKind::Tree) {
     if ((dpf_size & (dpf_size - 1)) != 0) throw invalid_argument("dpf_size must be power of two");
-    int depth = 0;
-    {
-        size_t tmp = dpf_size;
-        while (tmp > 1) { tmp >>= 1; ++depth; }
+    if (out_bits == 0 || out_bits > 128 || (out_bits & (out_bits - 1)) != 0) {
+        throw invalid_argument("out_bits must be a power of two in [1, 128]");
     }
+    if ((value & ~output_mask(out_bits)) != 0) throw invalid_argument("value does not fit in out_bits");
 
     DPFKey k0, k1;
+    k0.out_bits = out_bits;
+    k1.out_bits = out_bits;
+    int shift = leaf_shift(k0);
+    int depth = max(0, log2_floor(dpf_size) - shift);
+    uint64_t leaf = location >> shift;
+    size_t slot = location & ((size_t(1) << shift) - 1);
+    if (kind == DPFKind::Sqrt) return generateSqrtDPF(depth, leaf, value << (slot * out_bits), out_bits);
+
     k0.levels.resize(depth);
     k1.levels.resize(depth);
     // Use cryptographically secure random 128-bit root seeds
@@ -147,13 +233,12 @@ pair<DPFKey, DPFKey> generateDPF(size_t dpf_size, uint64_t location, uint128_t v
     bool f1 = k1.root_flag;
 
     for (int i = 0; i < depth; ++i) {
-        // Expand seed into left/right using PRG(seed || bit)
-        PRGSingle out0L = prg_expand_bit(s0, 0);
-        PRGSingle out0R = prg_expand_bit(s0, 1);
-        PRGSingle out1L = prg_expand_bit(s1, 0);
-        PRGSingle out1R = prg_expand_bit(s1, 1);
+        // Expand both seeds into left/right children
+        PRGSingle out0L, out0R, out1L, out1R;
+        prg_expand(s0, out0L, out0R);
+        prg_expand(s1, out1L, out1R);
 
-        bool path_bit = ((location >> (depth - 1 - i)) & 1u);
+        bool path_bit = ((leaf >> (depth - 1 - i)) & 1u);
 
         uint128_t sCW;
         bool tLcw, tRcw;
@@ -216,21 +301,23 @@ pair<DPFKey, DPFKey> generateDPF(size_t dpf_size, uint64_t location, uint128_t v
         }
     }
 
-    k0.final_cw = value ^ s0 ^ s1;
+    k0.final_cw = (value << (slot * out_bits)) ^ s0 ^ s1;
     k1.final_cw = k0.final_cw;
 
     return {k0, k1};
 }
 
-uint128_t evalDPF(const DPFKey& key, uint64_t index) {
-    int depth = static_cast<int>(key.levels.size());
-    uint128_t s = key.root_seed;
-    bool f = key.root_flag;
+// Walks `levels` levels down from the root along the top bits of `path`
+// (bit levels-1 first), leaving the seed and control bit of that node in s, f.
+template <class Key>
+static void descend(const Key& key, int levels, uint64_t path, uint128_t& s, bool& f) {
+    s = key.root_seed;
+    f = key.root_flag;
 
-    for (int i = 0; i < depth; ++i) {
-        // Expand both children using PRG(seed || bit)
-        PRGSingle outL = prg_expand_bit(s, 0);
-        PRGSingle outR = prg_expand_bit(s, 1);
+    for (int i = 0; i < levels; ++i) {
+        // Expand both children in one PRG call
+        PRGSingle outL, outR;
+        prg_expand(s, outL, outR);
 
         if (f) {
             const DPFLevel& L = key.levels[i];
@@ -240,7 +327,7 @@ uint128_t evalDPF(const DPFKey& key, uint64_t index) {
             outR.t = static_cast<bool>(outR.t ^ L.tR_cw);
         }
 
-        bool bit = ((index >> (depth - 1 - i)) & 1u);
+        bool bit = ((path >> (levels - 1 - i)) & 1u);
         if (!bit) {
             s = outL.s;
             f = outL.t;
@@ -249,25 +336,473 @@ uint128_t evalDPF(const DPFKey& key, uint64_t index) {
             f = outR.t;
         }
     }
+}
 
-    return s ^ (f ? key.final_cw : (uint128_t)0);
+template <class Key>
+uint128_t evalDPF(const Key& key, uint64_t index) {
+    if (const DPFKey* sq = as_sqrt(key)) return unpack_output(key, evalSqrtLeaf(*sq, index >> leaf_shift(key)), index);
+    uint128_t s;
+    bool f;
+    descend(key, static_cast<int>(key.levels.size()), index >> leaf_shift(key), s, f);
+    return unpack_output(key, s ^ (f ? key.final_cw : (uint128_t)0), index);
 }
 
-bool EvalFull(const DPFKey& key0, const DPFKey& key1, size_t dpf_size, uint64_t location, uint128_t value) {
-    bool ok = true;
-    for (uint64_t i = 0; i < dpf_size; ++i) {
-        uint128_t v0 = evalDPF(key0, i);
-        uint128_t v1 = evalDPF(key1, i);
-        uint128_t combined = v0 ^ v1;
-        if (i == location) {
-            if (combined != value) {
-                cerr << "  [FAIL] target " << i << ": expected " << uint128_to_string(value)
-                          << ", got " << uint128_to_string(combined) << "\n";
-                ok = false;
+// Nodes expanded per PRG batch and key in expand_levels_multi
+static constexpr size_t NODE_BATCH = 8;
+
+// Expands `width` consecutive nodes of level `from` down to level `to` for k
+// keys at once. Key m keeps its nodes in out[m*stride ..] with control bits in
+// t[m*stride ..]. Each level is expanded in place from the highest node down,
+// so out doubles as the seed workspace. Nodes are gathered NODE_BATCH at a time
+// from every key so the PRG always has k*NODE_BATCH independent blocks to
+// pipeline, even on the narrow top levels.
+template <class Key>
+static void expand_levels_multi(const Key* keys, size_t k, size_t stride, int from, int to,
+                                size_t width, uint128_t* out, uint8_t* t) {
+    vector<uint128_t> seeds(k * NODE_BATCH), cl(k * NODE_BATCH), cr(k * NODE_BATCH);
+    vector<uint8_t> flags(k * NODE_BATCH);
+    for (int i = from; i < to; ++i, width <<= 1) {
+        for (size_t hi = width; hi > 0;) {
+            size_t lo = hi > NODE_BATCH ? hi - NODE_BATCH : 0;
+            size_t n = hi - lo;
+            for (size_t m = 0; m < k; ++m) {
+                for (size_t q = 0; q < n; ++q) {
+                    seeds[m * n + q] = out[m * stride + lo + q];
+                    flags[m * n + q] = t[m * stride + lo + q];
+                }
             }
-        } else {
-            if (combined != 0) {
-                cerr << "  [FAIL] non-target " << i << " got " << uint128_to_string(combined) << "\n";
+            prg_expand_many(seeds.data(), k * n, cl.data(), cr.data());
+            // Children of nodes lo..hi-1 land at 2*lo and above, never on an
+            // unread node below lo
+            for (size_t m = 0; m < k; ++m) {
+                const DPFLevel& L = keys[m].levels[i];
+                uint128_t* o = out + m * stride;
+                uint8_t* tm = t + m * stride;
+                for (size_t q = 0; q < n; ++q) {
+                    // Branch-free correction: control bits are random
+                    uint8_t f = flags[m * n + q];
+                    uint128_t scw = L.scw & -(uint128_t)f;
+                    uint128_t sl = cl[m * n + q], sr = cr[m * n + q];
+                    size_t j = lo + q;
+                    o[2 * j] = sl ^ scw;
+                    tm[2 * j] = static_cast<uint8_t>((sl & 1u) ^ (L.tL_cw & f));
+                    o[2 * j + 1] = sr ^ scw;
+                    tm[2 * j + 1] = static_cast<uint8_t>((sr & 1u) ^ (L.tR_cw & f));
+                }
+            }
+            hi = lo;
+        }
+    }
+}
+
+template <class Key>
+static void expand_levels(const Key& key, int from, int to, size_t width, uint128_t* out, uint8_t* t) {
+    expand_levels_multi(&key, 1, 0, from, to, width, out, t);
+}
+
+template <class Key>
+static void apply_final_cw(const Key& key, size_t n, uint128_t* out, const uint8_t* t) {
+    for (size_t x = 0; x < n; ++x) {
+        if (t[x]) out[x] ^= key.final_cw;
+    }
+}
+
+// Spreads the leaf words in out[0..) into one output per domain point, in
+// place from the back (point x reads word x/per_leaf <= x, never overwritten yet)
+template <class Key>
+static void unpack_leaves(const Key& key, size_t dpf_size, uint128_t* out) {
+    if (key.out_bits == 128) return;
+    int shift = leaf_shift(key);
+    for (size_t x = dpf_size; x-- > 0;) out[x] = unpack_output(key, out[x >> shift], x);
+}
+
+// Packed full-domain expansion: walks the tree once, level by level, writing
+// the leaf words into out[0..leaves). That is dpf_size words in the classic
+// layout and dpf_size*out_bits/128 with early termination, for leaves - 1 PRG
+// calls (2 children each).
+template <class Key>
+void evalFullDPFPacked(const Key& key, size_t dpf_size, uint128_t* out) {
+    size_t leaves = leaf_count(key, dpf_size);
+    if (const DPFKey* sq = as_sqrt(key)) {
+        evalSqrtRows(*sq, 0, sq->row_seeds.size(), out);
+        return;
+    }
+    int depth = static_cast<int>(key.levels.size());
+
+    vector<uint8_t> t(leaves);
+    out[0] = key.root_seed;
+    t[0] = key.root_flag;
+    expand_levels(key, 0, depth, 1, out, t.data());
+    apply_final_cw(key, leaves, out, t.data());
+}
+
+// Full-domain expansion into one output per domain point, out[0..dpf_size)
+template <class Key>
+void evalFullDPF(const Key& key, size_t dpf_size, uint128_t* out) {
+    evalFullDPFPacked(key, dpf_size, out);
+    unpack_leaves(key, dpf_size, out);
+}
+
+// Parallel packed expansion, bit-identical to evalFullDPFPacked. The top
+// levels are expanded serially until there are at least 8 subtrees per
+// worker; each subtree root is then moved to the start of its leaf range and
+// the subtrees are expanded in place as independent pool tasks.
+template <class Key>
+void evalFullDPFPackedParallel(const Key& key, size_t dpf_size, uint128_t* out, WorkStealingPool& pool) {
+    size_t leaves = leaf_count(key, dpf_size);
+    int depth = static_cast<int>(key.levels.size());
+    if (pool.size() == 1) {
+        evalFullDPFPacked(key, dpf_size, out);
+        return;
+    }
+    if (const DPFKey* sq = as_sqrt(key)) {
+        // Rows are independent: one contiguous range of rows per task
+        size_t rows = sq->row_seeds.size();
+        size_t tasks = min(rows, 8 * (size_t)pool.size());
+        pool.run(tasks, [&](size_t r) { evalSqrtRows(*sq, r * rows / tasks, (r + 1) * rows / tasks, out); });
+        return;
+    }
+
+    int split = 0;
+    while (split < depth && (size_t(1) << split) < 8 * (size_t)pool.size()) ++split;
+    size_t subtrees = size_t(1) << split;
+    size_t sub_size = leaves >> split;
+
+    vector<uint8_t> t(leaves);
+    out[0] = key.root_seed;
+    t[0] = key.root_flag;
+    expand_levels(key, 0, split, 1, out, t.data());
+    for (size_t r = subtrees; r-- > 1;) {
+        out[r * sub_size] = out[r];
+        t[r * sub_size] = t[r];
+    }
+
+    pool.run(subtrees, [&](size_t r) {
+        uint128_t* o = out + r * sub_size;
+        uint8_t* tr = t.data() + r * sub_size;
+        expand_levels(key, split, depth, 1, o, tr);
+        apply_final_cw(key, sub_size, o, tr);
+    });
+}
+
+// Parallel evalFullDPF, bit-identical to the serial one
+template <class Key>
+void evalFullDPFParallel(const Key& key, size_t dpf_size, uint128_t* out, WorkStealingPool& pool) {
+    evalFullDPFPackedParallel(key, dpf_size, out, pool);
+    unpack_leaves(key, dpf_size, out);
+}
+
+// Leaf words per digest chunk (64 KiB of seeds per worker)
+static constexpr int DIGEST_CHUNK_LOG = 12;
+
+// Streaming digest of one key's packed full-domain output under challenge r:
+//   H = sum_w out[w] * r^(leaves - w)   over GF(2^128).
+// H is GF(2)-linear in the output, so the XOR of both parties' digests is the
+// digest of the reconstructed function (see expectedDigest). The leaves are
+// produced chunk by chunk, each chunk root reached by a walk from the root, so
+// memory is one chunk per worker whatever the domain size. Chunks are split
+// into one contiguous range per task; a range is hashed by Horner's rule and
+// shifted to its place with a single power of r.
+template <class Key>
+uint128_t digestFullDPF(const Key& key, size_t dpf_size, uint128_t r, WorkStealingPool& pool) {
+    size_t leaves = leaf_count(key, dpf_size);
+    int depth = static_cast<int>(key_depth(key));
+    const DPFKey* sq = as_sqrt(key);
+    // A square-root key is hashed one grid row at a time
+    int split = sq ? log2_floor(sq->row_seeds.size()) : max(0, depth - DIGEST_CHUNK_LOG);
+    size_t chunks = size_t(1) << split;
+    size_t chunk = leaves >> split;
+    size_t tasks = min(chunks, 8 * (size_t)pool.size());
+
+    mutex m;
+    uint128_t digest = 0;
+    pool.run(tasks, [&](size_t task) {
+        size_t c0 = task * chunks / tasks, c1 = (task + 1) * chunks / tasks;
+        vector<uint128_t> buf(chunk);
+        vector<uint8_t> t(chunk);
+        uint128_t h = 0;
+        for (size_t c = c0; c < c1; ++c) {
+            if (sq) {
+                evalSqrtRow(*sq, c, buf.data());
+                for (size_t w = 0; w < chunk; ++w) h = gf128_mul(h, r) ^ buf[w];
+                continue;
+            }
+            bool f;
+            descend(key, split, c, buf[0], f);
+            t[0] = f;
+            expand_levels(key, split, depth, 1, buf.data(), t.data());
+            apply_final_cw(key, chunk, buf.data(), t.data());
+            for (size_t w = 0; w < chunk; ++w) h = gf128_mul(h, r) ^ buf[w];
+        }
+        // h = sum out[w] * r^(end - 1 - w) over this range
+        h = gf128_mul(h, gf128_pow(r, leaves - c1 * chunk + 1));
+        lock_guard<mutex> lk(m);
+        digest ^= h;
+    });
+    return digest;
+}
+
+// Digest of the point function itself: the only non-zero leaf word is the one
+// holding location, carrying value in its slot.
+static uint128_t expectedDigest(size_t leaves, int shift, uint32_t out_bits, uint64_t location,
+                                uint128_t value, uint128_t r) {
+    if (out_bits == 128) shift = 0;
+    uint64_t w = location >> shift;
+    uint64_t slot = location & ((uint64_t(1) << shift) - 1);
+    return gf128_mul(value << (slot * out_bits), gf128_pow(r, leaves - w));
+}
+
+// Sparse evaluation of one key at many indices. The indices are sorted and the
+// tree is walked once, level by level, expanding only nodes with at least one
+// requested index below them, so the cost is the size of the union of the
+// root-to-leaf paths rather than |indices| * depth. Each level's frontier goes
+// through one prg_expand_many. out[j] is the output at indices[j]; if
+// expansions is given, the number of PRG calls is added to it.
+template <class Key>
+vector<uint128_t> EvalBatch(const Key& key, const vector<uint64_t>& indices, size_t* expansions = nullptr) {
+    size_t n = indices.size();
+    vector<uint128_t> out(n);
+    if (n == 0) return out;
+    if (const DPFKey* sq = as_sqrt(key)) {
+        // One PRG call per index already, nothing to share
+        for (size_t j = 0; j < n; ++j) out[j] = evalDPF(*sq, indices[j]);
+        if (expansions) *expansions += n;
+        return out;
+    }
+    int depth = static_cast<int>(key.levels.size());
+    int shift = leaf_shift(key);
+
+    // Scratch buffers are kept per thread and only ever grow: reallocating
+    // them per call costs more in page faults than the walk itself
+    thread_local struct {
+        vector<pair<uint64_t, size_t>> sorted, tmp;
+        vector<uint64_t> leaf;
+        vector<size_t> order;
+        vector<uint128_t> s, next_s, cl, cr;
+        vector<uint8_t> t, next_t;
+        vector<pair<size_t, size_t>> range, next_range;
+    } sc;
+    auto grow = [n](auto&... v) { (v.resize(max(v.size(), n)), ...); };
+    grow(sc.sorted, sc.tmp, sc.leaf, sc.order, sc.s, sc.next_s, sc.cl, sc.cr, sc.t, sc.next_t, sc.range, sc.next_range);
+
+    // LSD radix sort of (leaf, position) by leaf, 11 bits per pass: O(n) per
+    // pass where a comparison sort would dominate the whole evaluation. Small
+    // batches are cheaper to comparison-sort than to clear 2048 buckets for.
+    auto& sorted = sc.sorted;
+    auto& tmp = sc.tmp;
+    for (size_t j = 0; j < n; ++j) sorted[j] = {indices[j] >> shift, j};
+    if (n < 256) {
+        sort(sorted.begin(), sorted.begin() + n);
+    }
+    for (int lo_bit = 0; n >= 256 && lo_bit < depth; lo_bit += 11) {
+        size_t count[2049] = {0};
+        for (size_t j = 0; j < n; ++j) ++count[((sorted[j].first >> lo_bit) & 2047) + 1];
+        for (int d = 0; d < 2048; ++d) count[d + 1] += count[d];
+        for (size_t j = 0; j < n; ++j) tmp[count[(sorted[j].first >> lo_bit) & 2047]++] = sorted[j];
+        swap(sorted, tmp);
+    }
+    auto& leaf = sc.leaf;
+    auto& order = sc.order;
+    for (size_t j = 0; j < n; ++j) {
+        leaf[j] = sorted[j].first;
+        order[j] = sorted[j].second;
+    }
+
+    // Frontier: node seeds, control bits and the [lo, hi) range of sorted
+    // indices under each node; it never holds more than n nodes
+    auto& s = sc.s;
+    auto& next_s = sc.next_s;
+    auto& cl = sc.cl;
+    auto& cr = sc.cr;
+    auto& t = sc.t;
+    auto& next_t = sc.next_t;
+    auto& range = sc.range;
+    auto& next_range = sc.next_range;
+    s[0] = key.root_seed;
+    t[0] = key.root_flag;
+    range[0] = {0, n};
+    size_t w = 1;
+
+    for (int i = 0; i < depth; ++i) {
+        prg_expand_many(s.data(), w, cl.data(), cr.data());
+        if (expansions) *expansions += w;
+
+        const DPFLevel L = key.levels[i];
+        int bit = depth - 1 - i;
+        size_t next_w = 0;
+        for (size_t q = 0; q < w; ++q) {
+            auto [lo, hi] = range[q];
+            // Sorted range: if the first and last index agree on this bit,
+            // everything goes one way, which is the common case deep down
+            size_t mid;
+            bool first_bit = (leaf[lo] >> bit) & 1u;
+            bool last_bit = (leaf[hi - 1] >> bit) & 1u;
+            if (first_bit == last_bit) {
+                mid = first_bit ? lo : hi;
+            } else {
+                mid = partition_point(leaf.begin() + lo, leaf.begin() + hi,
+                                      [bit](uint64_t x) { return ((x >> bit) & 1u) == 0; }) - leaf.begin();
+            }
+            uint128_t scw = L.scw & -(uint128_t)t[q];
+            if (mid > lo) {
+                next_s[next_w] = cl[q] ^ scw;
+                next_t[next_w] = static_cast<uint8_t>((cl[q] & 1u) ^ (L.tL_cw & t[q]));
+                next_range[next_w++] = {lo, mid};
+            }
+            if (hi > mid) {
+                next_s[next_w] = cr[q] ^ scw;
+                next_t[next_w] = static_cast<uint8_t>((cr[q] & 1u) ^ (L.tR_cw & t[q]));
+                next_range[next_w++] = {mid, hi};
+            }
+        }
+        swap(s, next_s);
+        swap(t, next_t);
+        swap(range, next_range);
+        w = next_w;
+    }
+
+    for (size_t q = 0; q < w; ++q) {
+        uint128_t v = s[q] ^ (t[q] ? key.final_cw : (uint128_t)0);
+        for (size_t j = range[q].first; j < range[q].second; ++j) {
+            out[order[j]] = unpack_output(key, v, indices[order[j]]);
+        }
+    }
+    return out;
+}
+
+// Batch key generation: num_keys DPFs with random locations and value 1,
+// generated on the pool (each worker draws from its own thread-local CSPRNG
+// buffer and PRG context) and written straight into <prefix>.k0 / <prefix>.k1.
+// Returns the locations, which stay with the client.
+vector<uint64_t> generateKeyFiles(const string& prefix, size_t dpf_size, size_t num_keys, uint32_t out_bits,
+                                  WorkStealingPool& pool) {
+    DPFKey shape;
+    shape.out_bits = out_bits;
+    uint32_t depth = (uint32_t)max(0, log2_floor(dpf_size) - leaf_shift(shape));
+    KeyFileWriter w0(prefix + ".k0", 0, dpf_size, num_keys, depth, out_bits, g_prg_backend);
+    KeyFileWriter w1(prefix + ".k1", 1, dpf_size, num_keys, depth, out_bits, g_prg_backend);
+
+    vector<uint64_t> locations(num_keys);
+    const size_t chunk = 4096;
+    pool.run((num_keys + chunk - 1) / chunk, [&](size_t c) {
+        for (size_t i = c * chunk; i < min(num_keys, (c + 1) * chunk); ++i) {
+            locations[i] = secure_rand64() % dpf_size;
+            auto [k0, k1] = generateDPF(dpf_size, locations[i], 1, out_bits);
+            w0.write(i, k0);
+            w1.write(i, k1);
+        }
+    });
+    return locations;
+}
+
+static int batch_depth(const DPFKey* keys, size_t k) {
+    for (size_t m = 0; m < k; ++m) {
+        if (keys[m].kind != DPFKind::Tree) throw invalid_argument("batched evaluation needs tree keys");
+    }
+    int depth = static_cast<int>(keys[0].levels.size());
+    for (size_t m = 1; m < k; ++m) {
+        if (keys[m].levels.size() != (size_t)depth || keys[m].out_bits != keys[0].out_bits) {
+            throw invalid_argument("batched keys must share a depth and output width");
+        }
+    }
+    return depth;
+}
+
+// Point evaluation of k keys, key m at indices[m], walked down the tree
+// together so every level is one prg_expand_many over k seeds.
+void evalDPFBatch(const DPFKey* keys, const uint64_t* indices, size_t k, uint128_t* out) {
+    if (k == 0) return;
+    int depth = batch_depth(keys, k);
+    int shift = leaf_shift(keys[0]);
+    vector<uint128_t> s(k), cl(k), cr(k);
+    vector<uint8_t> f(k);
+    for (size_t m = 0; m < k; ++m) {
+        s[m] = keys[m].root_seed;
+        f[m] = keys[m].root_flag;
+    }
+    for (int i = 0; i < depth; ++i) {
+        prg_expand_many(s.data(), k, cl.data(), cr.data());
+        for (size_t m = 0; m < k; ++m) {
+            const DPFLevel& L = keys[m].levels[i];
+            bool bit = ((indices[m] >> (shift + depth - 1 - i)) & 1u);
+            // Branch-free: the index bits and control bits are random
+            uint128_t c = bit ? cr[m] : cl[m];
+            uint8_t tcw = bit ? L.tR_cw : L.tL_cw;
+            s[m] = c ^ (L.scw & -(uint128_t)f[m]);
+            f[m] = static_cast<uint8_t>((c & 1u) ^ (tcw & f[m]));
+        }
+    }
+    for (size_t m = 0; m < k; ++m) {
+        out[m] = unpack_output(keys[m], s[m] ^ (f[m] ? keys[m].final_cw : (uint128_t)0), indices[m]);
+    }
+}
+
+// Full-domain evaluation of k keys expanded level by level together; key m's
+// leaves go to out[m*dpf_size .. (m+1)*dpf_size).
+void evalFullDPFBatch(const DPFKey* keys, size_t k, size_t dpf_size, uint128_t* out) {
+    if (k == 0) return;
+    int depth = batch_depth(keys, k);
+    size_t leaves = leaf_count(keys[0], dpf_size);
+
+    // The narrow top levels are where a single key cannot fill the PRG
+    // pipeline, so expand those for all keys together in a small scratch
+    // buffer. Below that each key already has NODE_BATCH independent nodes per
+    // call and is finished on its own, keeping the working set to one key.
+    int shared = 0;
+    while (shared < depth && (size_t(1) << shared) < NODE_BATCH) ++shared;
+    size_t top = size_t(1) << shared;
+    vector<uint128_t> top_s(k * top);
+    vector<uint8_t> top_t(k * top);
+    for (size_t m = 0; m < k; ++m) {
+        top_s[m * top] = keys[m].root_seed;
+        top_t[m * top] = keys[m].root_flag;
+    }
+    expand_levels_multi(keys, k, top, 0, shared, 1, top_s.data(), top_t.data());
+
+    vector<uint8_t> t(leaves);
+    for (size_t m = 0; m < k; ++m) {
+        uint128_t* o = out + m * dpf_size;
+        copy(top_s.begin() + m * top, top_s.begin() + (m + 1) * top, o);
+        copy(top_t.begin() + m * top, top_t.begin() + (m + 1) * top, t.begin());
+        expand_levels(keys[m], shared, depth, top, o, t.data());
+        apply_final_cw(keys[m], leaves, o, t.data());
+        unpack_leaves(keys[m], dpf_size, o);
+    }
+}
+
+static unsigned g_threads = max(1u, thread::hardware_concurrency());
+
+// Pool shared by EvalFull/EvalSample, sized by --threads on first use
+static WorkStealingPool& eval_pool() {
+    static WorkStealingPool pool(g_threads);
+    return pool;
+}
+
+// Expands both keys once and checks the packed leaf words: the word holding
+// location must reconstruct to value in its slot, every other bit to zero.
+template <class Key>
+bool EvalFull(const Key& key0, const Key& key1, size_t dpf_size, uint64_t location, uint128_t value) {
+    bool ok = true;
+    size_t leaves = leaf_count(key0, dpf_size);
+    int shift = leaf_shift(key0);
+    unique_ptr<uint128_t[]> out0(new uint128_t[leaves]);
+    unique_ptr<uint128_t[]> out1(new uint128_t[leaves]);
+    evalFullDPFPackedParallel(key0, dpf_size, out0.get(), eval_pool());
+    evalFullDPFPackedParallel(key1, dpf_size, out1.get(), eval_pool());
+    for (uint64_t w = 0; w < leaves; ++w) {
+        uint128_t combined = out0[w] ^ out1[w];
+        if (combined == 0 && w != (location >> shift)) continue;
+        // Report per domain point inside a non-zero or target word
+        for (uint64_t i = w << shift; i < ((w + 1) << shift) && i < dpf_size; ++i) {
+            uint128_t v = unpack_output(key0, combined, i);
+            if (i == location) {
+                if (v != value) {
+                    cerr << "  [FAIL] target " << i << ": expected " << uint128_to_string(value)
+                              << ", got " << uint128_to_string(v) << "\n";
+                    ok = false;
+                }
+            } else if (v != 0) {
+                cerr << "  [FAIL] non-target " << i << " got " << uint128_to_string(v) << "\n";
                 ok = false;
             }
         }
@@ -275,36 +810,38 @@ bool EvalFull(const DPFKey& key0, const DPFKey& key1, size_t dpf_size, uint64_t
     return ok;
 }
 
-bool EvalSample(const DPFKey& key0, const DPFKey& key1, size_t dpf_size, uint64_t location, uint128_t value, size_t sample_count) {
+template <class Key>
+bool EvalSample(const Key& key0, const Key& key1, size_t dpf_size, uint64_t location, uint128_t value, size_t sample_count) {
     if (sample_count == 0 || sample_count >= dpf_size - 1) return EvalFull(key0, key1, dpf_size, location, value);
     bool ok = true;
-    // Check target
-    uint128_t v0 = evalDPF(key0, location);
-    uint128_t v1 = evalDPF(key1, location);
-    uint128_t combined = v0 ^ v1;
-    if (combined != value) {
-        cerr << "  [FAIL] target " << location << ": expected " << uint128_to_string(value)
-                  << ", got " << uint128_to_string(combined) << "\n";
-        ok = false;
-    }
 
-    // Sample random non-target indices
-    size_t found = 0;
+    // Target plus random non-target indices, evaluated with one EvalBatch per key
+    vector<uint64_t> points{location};
     size_t attempts = 0;
     const size_t max_attempts = sample_count * 10 + 100;
     unordered_set<uint64_t> seen;
-    while (found < sample_count && attempts < max_attempts) {
+    while (points.size() - 1 < sample_count && attempts < max_attempts) {
         ++attempts;
         uint64_t r = secure_rand64() % dpf_size;
         if (r == location) continue;
         if (seen.count(r)) continue;
         seen.insert(r);
-        ++found;
-        uint128_t a0 = evalDPF(key0, r);
-        uint128_t a1 = evalDPF(key1, r);
-        uint128_t comb = a0 ^ a1;
+        points.push_back(r);
+    }
+    size_t found = points.size() - 1;
+
+    vector<uint128_t> v0 = EvalBatch(key0, points);
+    vector<uint128_t> v1 = EvalBatch(key1, points);
+    uint128_t combined = v0[0] ^ v1[0];
+    if (combined != value) {
+        cerr << "  [FAIL] target " << location << ": expected " << uint128_to_string(value)
+                  << ", got " << uint128_to_string(combined) << "\n";
+        ok = false;
+    }
+    for (size_t j = 1; j < points.size(); ++j) {
+        uint128_t comb = v0[j] ^ v1[j];
         if (comb != 0) {
-            cerr << "  [FAIL] sampled non-target " << r << " got " << uint128_to_string(comb) << "\n";
+            cerr << "  [FAIL] sampled non-target " << points[j] << " got " << uint128_to_string(comb) << "\n";
             ok = false;
         }
     }
@@ -314,9 +851,287 @@ bool EvalSample(const DPFKey& key0, const DPFKey& key1, size_t dpf_size, uint64_
     return ok;
 }
 
+// Digest verification: both parties hash their full-domain output under a
+// shared random challenge drawn after the keys are fixed and exchange only the
+// 16-byte digests. A wrong output anywhere makes the difference of the two
+// sides a non-zero polynomial in r of degree <= leaves, so it is missed with
+// probability at most leaves / 2^128.
+template <class Key>
+bool EvalDigest(const Key& key0, const Key& key1, size_t dpf_size, uint64_t location, uint128_t value) {
+    uint128_t r = secure_rand128();
+    uint128_t h0 = digestFullDPF(key0, dpf_size, r, eval_pool());
+    uint128_t h1 = digestFullDPF(key1, dpf_size, r, eval_pool());
+    uint128_t expected = expectedDigest(leaf_count(key0, dpf_size), leaf_shift(key0), key0.out_bits,
+                                        location, value, r);
+    if ((h0 ^ h1) != expected) {
+        cerr << "  [FAIL] digest mismatch: expected " << uint128_to_string(expected) << ", got "
+             << uint128_to_string(h0 ^ h1) << "\n";
+        return false;
+    }
+    return true;
+}
+
+static double seconds_since(chrono::steady_clock::time_point t0) {
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+// Node expansions per second of generateDPF / evalDPF under each PRG backend
+static void bench_prg(size_t dpf_size, int num_dpfs) {
+    PRGBackend saved = g_prg_backend;
+    size_t depth = 0;
+    while ((size_t(1) << depth) < dpf_size) ++depth;
+    const int evals_per_key = 256;
+
+    cout << "backend,dpf_size,keys,gen_expansions_per_s,eval_expansions_per_s\n";
+    for (PRGBackend b : {PRGBackend::SHA256, PRGBackend::AES}) {
+        g_prg_backend = b;
+        vector<pair<DPFKey, DPFKey>> keys;
+        keys.reserve(num_dpfs);
+
+        auto t0 = chrono::steady_clock::now();
+        for (int i = 0; i < num_dpfs; ++i) {
+            keys.push_back(generateDPF(dpf_size, secure_rand64() % dpf_size, 1));
+        }
+        double gen_s = seconds_since(t0);
+
+        volatile uint64_t sink = 0;
+        t0 = chrono::steady_clock::now();
+        for (const auto& kp : keys) {
+            for (int e = 0; e < evals_per_key; ++e) {
+                sink = sink ^ (uint64_t)evalDPF(kp.first, (uint64_t)e * 2654435761u % dpf_size);
+            }
+        }
+        double eval_s = seconds_since(t0);
+
+        // generateDPF expands two seeds per level, evalDPF one
+        double gen_nodes = 2.0 * depth * num_dpfs;
+        double eval_nodes = (double)depth * num_dpfs * evals_per_key;
+        cout << prg_backend_name(b) << "," << dpf_size << "," << num_dpfs << ","
+             << gen_nodes / gen_s << "," << eval_nodes / eval_s << "\n";
+    }
+    g_prg_backend = saved;
+}
+
+// Leaves per second of one key: per-index evalDPF vs. full-domain expansion
+static void bench_evalfull(size_t dpf_size, int num_dpfs) {
+    cout << "method,dpf_size,keys,seconds,leaves_per_s,MB_per_s\n";
+    vector<DPFKey> keys;
+    for (int i = 0; i < num_dpfs; ++i) {
+        keys.push_back(generateDPF(dpf_size, secure_rand64() % dpf_size, 1).first);
+    }
+    unique_ptr<uint128_t[]> out(new uint128_t[dpf_size]);
+    double leaves = (double)dpf_size * num_dpfs;
+    auto report = [&](const char* name, double secs) {
+        cout << name << "," << dpf_size << "," << num_dpfs << "," << secs << ","
+             << leaves / secs << "," << leaves * sizeof(uint128_t) / secs / 1e6 << "\n";
+    };
+
+    auto t0 = chrono::steady_clock::now();
+    for (const auto& k : keys) {
+        for (uint64_t i = 0; i < dpf_size; ++i) out[i] = evalDPF(k, i);
+    }
+    report("per_index", seconds_since(t0));
+
+    t0 = chrono::steady_clock::now();
+    for (const auto& k : keys) evalFullDPF(k, dpf_size, out.get());
+    report("full_domain", seconds_since(t0));
+}
+
+// Parallel EvalFull speedup over 1 thread for 2^16 .. dpf_size and
+// 1, 2, 4, .. g_threads workers
+static void bench_parallel(size_t dpf_size, int num_dpfs) {
+    cout << "dpf_size,threads,keys,seconds,leaves_per_s,speedup,identical\n";
+    for (size_t n = size_t(1) << 16; n <= dpf_size; n <<= 2) {
+        vector<DPFKey> keys;
+        for (int i = 0; i < num_dpfs; ++i) {
+            keys.push_back(generateDPF(n, secure_rand64() % n, 1).first);
+        }
+        unique_ptr<uint128_t[]> out(new uint128_t[n]);
+        unique_ptr<uint128_t[]> ref(new uint128_t[n]);
+        evalFullDPF(keys.back(), n, ref.get());
+        double base = 0;
+        for (unsigned th = 1;; th = min(th * 2, g_threads)) {
+            WorkStealingPool pool(th);
+            auto t0 = chrono::steady_clock::now();
+            for (const auto& k : keys) evalFullDPFParallel(k, n, out.get(), pool);
+            double secs = seconds_since(t0);
+            if (th == 1) base = secs;
+            cout << n << "," << th << "," << num_dpfs << "," << secs << ","
+                 << (double)n * num_dpfs / secs << "," << base / secs << ","
+                 << (memcmp(out.get(), ref.get(), n * sizeof(uint128_t)) == 0) << "\n";
+            if (th == g_threads) break;
+        }
+    }
+}
+
+// Batched vs. one-key-at-a-time evaluation of num_dpfs keys, in key x leaf
+// evaluations per second, for point queries and full-domain expansion
+static void bench_batch(size_t dpf_size, int num_dpfs) {
+    size_t k = num_dpfs;
+    const size_t rounds = 256;
+    vector<DPFKey> keys;
+    for (size_t m = 0; m < k; ++m) {
+        keys.push_back(generateDPF(dpf_size, secure_rand64() % dpf_size, 1).first);
+    }
+    vector<uint64_t> idx(rounds * k);
+    for (auto& x : idx) x = secure_rand64() % dpf_size;
+
+    cout << "mode,dpf_size,keys,single_key_evals_per_s,batched_key_evals_per_s,speedup,identical\n";
+    auto report = [&](const char* mode, double evals, double single_s, double batch_s, bool same) {
+        cout << mode << "," << dpf_size << "," << k << "," << evals / single_s << ","
+             << evals / batch_s << "," << single_s / batch_s << "," << same << "\n";
+    };
+
+    vector<uint128_t> single(rounds * k), batched(rounds * k);
+    auto t0 = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t m = 0; m < k; ++m) single[r * k + m] = evalDPF(keys[m], idx[r * k + m]);
+    }
+    double single_s = seconds_since(t0);
+    t0 = chrono::steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+        evalDPFBatch(keys.data(), idx.data() + r * k, k, batched.data() + r * k);
+    }
+    double batch_s = seconds_since(t0);
+    report("point", (double)rounds * k, single_s, batch_s, single == batched);
+
+    unique_ptr<uint128_t[]> full_single(new uint128_t[k * dpf_size]);
+    unique_ptr<uint128_t[]> full_batched(new uint128_t[k * dpf_size]);
+    t0 = chrono::steady_clock::now();
+    for (size_t m = 0; m < k; ++m) evalFullDPF(keys[m], dpf_size, full_single.get() + m * dpf_size);
+    single_s = seconds_since(t0);
+    t0 = chrono::steady_clock::now();
+    evalFullDPFBatch(keys.data(), k, dpf_size, full_batched.get());
+    batch_s = seconds_since(t0);
+    report("full", (double)k * dpf_size, single_s, batch_s,
+           memcmp(full_single.get(), full_batched.get(), k * dpf_size * sizeof(uint128_t)) == 0);
+}
+
+// Key size, generation and full-domain time for the classic layout vs. early
+// termination at several output widths. The unpacked output of every width is
+// checked against the point function the classic layout produces.
+static void bench_packed(size_t dpf_size, int num_dpfs) {
+    cout << "out_bits,dpf_size,keys,key_bytes,gen_us,evalfull_packed_ms,evalfull_unpacked_ms,matches_classic\n";
+    unique_ptr<uint128_t[]> a(new uint128_t[dpf_size]);
+    unique_ptr<uint128_t[]> b(new uint128_t[dpf_size]);
+    for (uint32_t bits : {128u, 64u, 32u, 8u, 1u}) {
+        double gen_s = 0, packed_s = 0, unpacked_s = 0;
+        bool same = true;
+        size_t key_bytes = 0;
+        for (int i = 0; i < num_dpfs; ++i) {
+            uint64_t loc = secure_rand64() % dpf_size;
+            auto t0 = chrono::steady_clock::now();
+            auto [k0, k1] = generateDPF(dpf_size, loc, 1, bits);
+            gen_s += seconds_since(t0);
+            key_bytes = key_size_bytes(k0);
+
+            t0 = chrono::steady_clock::now();
+            evalFullDPFPacked(k0, dpf_size, a.get());
+            packed_s += seconds_since(t0);
+
+            t0 = chrono::steady_clock::now();
+            evalFullDPF(k0, dpf_size, a.get());
+            unpacked_s += seconds_since(t0);
+            evalFullDPF(k1, dpf_size, b.get());
+            for (size_t x = 0; x < dpf_size; ++x) {
+                if ((a[x] ^ b[x]) != (x == loc ? 1 : 0)) same = false;
+            }
+        }
+        cout << bits << "," << dpf_size << "," << num_dpfs << "," << key_bytes << ","
+             << gen_s / num_dpfs * 1e6 << "," << packed_s / num_dpfs * 1e3 << ","
+             << unpacked_s / num_dpfs * 1e3 << "," << same << "\n";
+    }
+}
+
+// Sparse reads: per-index evalDPF vs. shared-prefix EvalBatch for growing
+// numbers of random indices per key
+static void bench_sparse(size_t dpf_size, int num_dpfs) {
+    cout << "dpf_size,indices,keys,per_index_us,evalbatch_us,per_index_prg_calls,evalbatch_prg_calls,speedup,identical\n";
+    vector<DPFKey> keys;
+    for (int i = 0; i < num_dpfs; ++i) {
+        keys.push_back(generateDPF(dpf_size, secure_rand64() % dpf_size, 1).first);
+    }
+    size_t depth = keys[0].levels.size();
+    for (size_t count = 16; count <= min<size_t>(dpf_size, 65536); count *= 4) {
+        vector<uint64_t> idx(count);
+        for (auto& x : idx) x = secure_rand64() % dpf_size;
+        double single_s = 0, batch_s = 0;
+        size_t batch_calls = 0;
+        bool same = true;
+        for (const auto& k : keys) {
+            vector<uint128_t> a(count);
+            auto t0 = chrono::steady_clock::now();
+            for (size_t j = 0; j < count; ++j) a[j] = evalDPF(k, idx[j]);
+            single_s += seconds_since(t0);
+            t0 = chrono::steady_clock::now();
+            vector<uint128_t> b = EvalBatch(k, idx, &batch_calls);
+            batch_s += seconds_since(t0);
+            same &= (a == b);
+        }
+        cout << dpf_size << "," << count << "," << num_dpfs << "," << single_s / num_dpfs * 1e6 << ","
+             << batch_s / num_dpfs * 1e6 << "," << count * depth << "," << batch_calls / num_dpfs << ","
+             << single_s / batch_s << "," << same << "\n";
+    }
+}
+
+// Digest verification vs. EvalFull for domain sizes 2^16 .. dpf_size: time per
+// key pair, peak output memory and bytes the two parties would exchange
+static void bench_digest(size_t dpf_size, int num_dpfs) {
+    cout << "dpf_size,keys,threads,evalfull_ms,digest_ms,evalfull_bytes,digest_bytes,exchanged_bytes,passed\n";
+    for (size_t n = min<size_t>(dpf_size, 65536); n <= dpf_size; n <<= 2) {
+        double full_s = 0, digest_s = 0;
+        bool passed = true;
+        for (int i = 0; i < num_dpfs; ++i) {
+            uint64_t loc = secure_rand64() % n;
+            auto [k0, k1] = generateDPF(n, loc, 1);
+            auto t0 = chrono::steady_clock::now();
+            passed &= EvalFull(k0, k1, n, loc, 1);
+            full_s += seconds_since(t0);
+            t0 = chrono::steady_clock::now();
+            passed &= EvalDigest(k0, k1, n, loc, 1);
+            digest_s += seconds_since(t0);
+        }
+        size_t chunk = min<size_t>(n, size_t(1) << DIGEST_CHUNK_LOG);
+        cout << n << "," << num_dpfs << "," << g_threads << "," << full_s / num_dpfs * 1e3 << ","
+             << digest_s / num_dpfs * 1e3 << "," << 2 * n * (sizeof(uint128_t) + 1) << ","
+             << g_threads * chunk * (sizeof(uint128_t) + 1) << "," << 2 * sizeof(uint128_t) << "," << passed
+             << "\n";
+        if (n > (SIZE_MAX >> 2)) break;
+    }
+}
+
+// Tree vs. square-root DPF for domain sizes 2^10 .. 2^24 (capped at dpf_size):
+// key size, generation time and serial full-domain time
+static void bench_sqrt(size_t dpf_size, int num_dpfs) {
+    cout << "dpf_size,keys,tree_key_bytes,sqrt_key_bytes,tree_gen_us,sqrt_gen_us,tree_full_ms,sqrt_full_ms,passed\n";
+    for (size_t n = 1024; n <= min<size_t>(dpf_size, size_t(1) << 24); n <<= 2) {
+        size_t bytes[2] = {0, 0};
+        double gen_s[2] = {0, 0}, full_s[2] = {0, 0};
+        bool passed = true;
+        unique_ptr<uint128_t[]> a(new uint128_t[n]), b(new uint128_t[n]);
+        for (int kind = 0; kind < 2; ++kind) {
+            for (int i = 0; i < num_dpfs; ++i) {
+                uint64_t loc = secure_rand64() % n;
+                auto t0 = chrono::steady_clock::now();
+                auto [k0, k1] = generateDPF(n, loc, 1, 128, kind ? DPFKind::Sqrt : DPFKind::Tree);
+                gen_s[kind] += seconds_since(t0);
+                bytes[kind] = key_size_bytes(k0);
+                t0 = chrono::steady_clock::now();
+                evalFullDPF(k0, n, a.get());
+                full_s[kind] += seconds_since(t0);
+                evalFullDPF(k1, n, b.get());
+                for (size_t x = 0; x < n; ++x) passed &= (a[x] ^ b[x]) == (x == loc ? 1 : 0);
+            }
+        }
+        cout << n << "," << num_dpfs << "," << bytes[0] << "," << bytes[1] << "," << gen_s[0] / num_dpfs * 1e6
+             << "," << gen_s[1] / num_dpfs * 1e6 << "," << full_s[0] / num_dpfs * 1e3 << ","
+             << full_s[1] / num_dpfs * 1e3 << "," << passed << "\n";
+    }
+}
+
 int main(int argc, char* argv[]) {
     if (argc < 3) {
-        cerr << "Usage: " << argv[0] << " <DPF_size> <num_DPFs> [--verify-sample N]\n";
+        cerr << "Usage: " << argv[0] << " <DPF_size> <num_DPFs> [--verify-sample N] [--verify-digest] [--prg aes|sha256] [--dpf tree|sqrt] [--threads T] [--out-bits L] [--gen-keys PREFIX] [--bench prg|evalfull|parallel|batch|packed|sparse|digest|sqrt]\n";
         return 1;
     }
     size_t dpf_size = stoull(argv[1]);
@@ -328,21 +1143,120 @@ int main(int argc, char* argv[]) {
 
     // Optional argument parsing for --verify-sample
     size_t sample_size_arg = SIZE_MAX; 
+    string bench_mode;
+    uint32_t out_bits = 128;
+    string gen_keys_prefix;
+    bool verify_digest = false;
+    DPFKind dpf_kind = DPFKind::Tree;
     for (int ai = 3; ai < argc; ++ai) {
         if (string(argv[ai]) == "--verify-sample" && ai + 1 < argc) {
             sample_size_arg = stoull(argv[++ai]);
+        } else if (string(argv[ai]) == "--verify-digest") {
+            verify_digest = true;
+        } else if (string(argv[ai]) == "--prg" && ai + 1 < argc) {
+            g_prg_backend = parse_prg_backend(argv[++ai]);
+        } else if (string(argv[ai]) == "--dpf" && ai + 1 < argc) {
+            string kind = argv[++ai];
+            if (kind == "tree") dpf_kind = DPFKind::Tree;
+            else if (kind == "sqrt") dpf_kind = DPFKind::Sqrt;
+            else {
+                cerr << "Unknown DPF construction: " << kind << "\n";
+                return 1;
+            }
+        } else if (string(argv[ai]) == "--gen-keys" && ai + 1 < argc) {
+            gen_keys_prefix = argv[++ai];
+        } else if (string(argv[ai]) == "--out-bits" && ai + 1 < argc) {
+            out_bits = (uint32_t)stoul(argv[++ai]);
+        } else if (string(argv[ai]) == "--threads" && ai + 1 < argc) {
+            g_threads = max(1u, (unsigned)stoul(argv[++ai]));
+        } else if (string(argv[ai]) == "--bench" && ai + 1 < argc) {
+            bench_mode = argv[++ai];
         } else {
             cerr << "Unknown option: " << argv[ai] << "\n";
             return 1;
         }
     }
 
-    cout << "Generating and testing " << num_dpfs << " DPFs of size " << dpf_size << "...\n";
+    if (bench_mode == "prg") {
+        bench_prg(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "evalfull") {
+        bench_evalfull(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "parallel") {
+        bench_parallel(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "batch") {
+        bench_batch(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "packed") {
+        bench_packed(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "sparse") {
+        bench_sparse(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "digest") {
+        bench_digest(dpf_size, num_dpfs);
+        return 0;
+    } else if (bench_mode == "sqrt") {
+        bench_sqrt(dpf_size, num_dpfs);
+        return 0;
+    } else if (!bench_mode.empty()) {
+        cerr << "Unknown bench: " << bench_mode << "\n";
+        return 1;
+    }
 
     size_t default_sample_size = (dpf_size > 65536) ? 1024 : 0;
 
     size_t sample_size = (sample_size_arg == SIZE_MAX) ? default_sample_size : sample_size_arg;
 
+    if (!gen_keys_prefix.empty()) {
+        if (dpf_kind != DPFKind::Tree) {
+            cerr << "Error: --gen-keys writes tree keys only.\n";
+            return 1;
+        }
+        WorkStealingPool pool(g_threads);
+        auto t0 = chrono::steady_clock::now();
+        vector<uint64_t> locations = generateKeyFiles(gen_keys_prefix, dpf_size, num_dpfs, out_bits, pool);
+        double secs = seconds_since(t0);
+        KeyFile f0(gen_keys_prefix + ".k0");
+        KeyFile f1(gen_keys_prefix + ".k1");
+        cout << "Wrote " << num_dpfs << " key pairs of size " << dpf_size << " to " << gen_keys_prefix
+             << ".k0/.k1 (" << f0.header().record_size << " bytes/key, " << f0.bytes() << " bytes/file) in "
+             << secs << " s, " << num_dpfs / secs << " keys/s with " << g_threads << " threads\n";
+
+        // Spot-check keys evaluated straight from the mapped files
+        bool success = true;
+        size_t checks = min<size_t>(num_dpfs, 64);
+        for (size_t c = 0; c < checks; ++c) {
+            size_t i = c * (size_t)num_dpfs / checks;
+            if (verify_digest) success &= EvalDigest(f0.key(i), f1.key(i), dpf_size, locations[i], 1);
+            else success &= EvalSample(f0.key(i), f1.key(i), dpf_size, locations[i], 1, sample_size);
+        }
+
+        // Keys only expand correctly under the PRG they were made with: the
+        // files must be refused under the other backend
+        PRGBackend saved = g_prg_backend;
+        g_prg_backend = saved == PRGBackend::AES ? PRGBackend::SHA256 : PRGBackend::AES;
+        bool refused = false;
+        try {
+            KeyFile wrong(gen_keys_prefix + ".k0");
+        } catch (const std::runtime_error&) {
+            refused = true;
+        }
+        g_prg_backend = saved;
+        if (!refused) cout << "Key file opened under the wrong PRG backend\n";
+        success &= refused;
+        if (success) cout << "Test Passed\n";
+        else cout << "Test Failed\n";
+        return success ? 0 : 1;
+    }
+
+    cout << "Generating and testing " << num_dpfs << " DPFs of size " << dpf_size
+         << " (PRG: " << prg_backend_name(g_prg_backend)
+         << ", " << (dpf_kind == DPFKind::Sqrt ? "sqrt" : "tree") << " DPF, " << out_bits << "-bit outputs)...\n";
+
+
     for (int i = 0; i < num_dpfs; ++i) {
         uint64_t random_location = secure_rand64() % dpf_size;
         uint128_t random_value = (uint128_t)1;
@@ -350,9 +1264,11 @@ int main(int argc, char* argv[]) {
         cout << "\n--- Test " << i + 1 << "/" << num_dpfs << " ---\n";
         cout << "Target Location: " << random_location << ", Target Value: " << uint128_to_string(random_value) << "\n";
 
-        auto [k0, k1] = generateDPF(dpf_size, random_location, random_value);
+        auto [k0, k1] = generateDPF(dpf_size, random_location, random_value, out_bits, dpf_kind);
         bool success;
-        if (sample_size == 0) {
+        if (verify_digest) {
+            success = EvalDigest(k0, k1, dpf_size, random_location, random_value);
+        } else if (sample_size == 0) {
             success = EvalFull(k0, k1, dpf_size, random_location, random_value);
         } else {
             success = EvalSample(k0, k1, dpf_size, random_location, random_value, sample_size);
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+#if defined(__PCLMUL__) && defined(__SSE2__)
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#define GQ_HAVE_PCLMUL 1
+#endif
+
+using uint128_t = __uint128_t;
+
+// Arithmetic in GF(2^128) = GF(2)[x] / (x^128 + x^7 + x^2 + x + 1), with bit i
+// of a uint128_t as the coefficient of x^i. Addition is XOR.
+
+// Bit-serial reference multiply
+inline uint128_t gf128_mul_portable(uint128_t a, uint128_t b) {
+    uint128_t r = 0;
+    for (int i = 0; i < 128; ++i) {
+        if ((b >> i) & 1u) r ^= a;
+        bool carry = static_cast<bool>(a >> 127);
+        a <<= 1;
+        if (carry) a ^= 0x87;
+    }
+    return r;
+}
+
+#ifdef GQ_HAVE_PCLMUL
+
+inline uint128_t gf128_mul(uint128_t a, uint128_t b) {
+    __m128i A, B;
+    std::memcpy(&A, &a, 16);
+    std::memcpy(&B, &b, 16);
+    // 256-bit carry-less product hi:lo
+    __m128i lo = _mm_clmulepi64_si128(A, B, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(A, B, 0x11);
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(A, B, 0x10), _mm_clmulepi64_si128(A, B, 0x01));
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+
+    // x^128 = x^7 + x^2 + x + 1: fold hi into lo twice (the first fold can
+    // spill up to 7 bits past x^128)
+    const __m128i poly = _mm_set_epi64x(0, 0x87);
+    __m128i t0 = _mm_clmulepi64_si128(hi, poly, 0x00);
+    __m128i t1 = _mm_clmulepi64_si128(hi, poly, 0x01);
+    lo = _mm_xor_si128(lo, t0);
+    lo = _mm_xor_si128(lo, _mm_slli_si128(t1, 8));
+    __m128i spill = _mm_srli_si128(t1, 8);
+    lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(spill, poly, 0x00));
+
+    uint128_t r;
+    std::memcpy(&r, &lo, 16);
+    return r;
+}
+
+#else
+
+inline uint128_t gf128_mul(uint128_t a, uint128_t b) {
+    return gf128_mul_portable(a, b);
+}
+
+#endif
+
+inline uint128_t gf128_pow(uint128_t a, uint64_t e) {
+    uint128_t r = 1;
+    while (e > 0) {
+        if (e & 1u) r = gf128_mul(r, a);
+        a = gf128_mul(a, a);
+        e >>= 1;
+    }
+    return r;
+}
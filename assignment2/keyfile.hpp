@@ -0,0 +1,230 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "prg.hpp"
+
+struct DPFLevel {
+    uint128_t scw;
+    bool tL_cw;
+    bool tR_cw;
+    bool keep_is_left;
+};
+
+// Tree: the O(log N) binary-tree DPF. Sqrt: leaf words laid out as a grid,
+// one seed and control bit per row plus one correction word per column.
+enum class DPFKind : uint32_t { Tree, Sqrt };
+
+struct DPFKey {
+    DPFKind kind = DPFKind::Tree;
+    uint128_t root_seed;
+    bool root_flag;
+    std::vector<DPFLevel> levels;
+    uint128_t final_cw;
+    std::vector<uint128_t> row_seeds; // Sqrt only
+    std::vector<uint8_t> row_flags;   // Sqrt only
+    std::vector<uint128_t> col_cw;    // Sqrt only
+    uint32_t out_bits = 128; // bits per output; a leaf packs 128/out_bits outputs
+};
+
+// ---------------------------------------------------------------------------
+// Binary key file, one per party. All fields are native little-endian.
+//
+//   header (64 bytes)
+//   record[num_keys], record_size bytes each (a multiple of 16):
+//     root_seed       16
+//     final_cw        16
+//     scw[depth]      16 * depth
+//     bits            ceil((1 + 2*depth) / 8): bit 0 root_flag,
+//                     bit 1+2i tL_cw of level i, bit 2+2i tR_cw of level i
+//     zero padding up to record_size
+//
+// keep_is_left is not stored: it is the path bit of the target index and
+// would hand the location to the server holding the file.
+// ---------------------------------------------------------------------------
+static constexpr char KEYFILE_MAGIC[8] = {'G', 'Q', 'D', 'P', 'F', 'K', 'E', 'Y'};
+static constexpr uint32_t KEYFILE_VERSION = 1;
+
+struct KeyFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t party;
+    uint64_t dpf_size;
+    uint64_t num_keys;
+    uint32_t depth;
+    uint32_t out_bits;
+    uint32_t prg;         // PRGBackend the keys were generated with
+    uint32_t record_size;
+    uint8_t reserved[16];
+};
+static_assert(sizeof(KeyFileHeader) == 64, "key file header must stay 64 bytes");
+
+inline size_t key_record_size(uint32_t depth) {
+    size_t bytes = 32 + 16 * (size_t)depth + (1 + 2 * (size_t)depth + 7) / 8;
+    return (bytes + 15) & ~size_t(15);
+}
+
+inline void encode_key_record(const DPFKey& key, unsigned char* rec, size_t record_size) {
+    std::memset(rec, 0, record_size);
+    size_t depth = key.levels.size();
+    std::memcpy(rec, &key.root_seed, 16);
+    std::memcpy(rec + 16, &key.final_cw, 16);
+    unsigned char* bits = rec + 32 + 16 * depth;
+    bits[0] = key.root_flag;
+    for (size_t i = 0; i < depth; ++i) {
+        std::memcpy(rec + 32 + 16 * i, &key.levels[i].scw, 16);
+        size_t bl = 1 + 2 * i, br = 2 + 2 * i;
+        bits[bl >> 3] |= static_cast<unsigned char>(key.levels[i].tL_cw) << (bl & 7);
+        bits[br >> 3] |= static_cast<unsigned char>(key.levels[i].tR_cw) << (br & 7);
+    }
+}
+
+// Read-only key over one record of a mapped file. Exposes the same members
+// the DPF evaluators use on DPFKey (levels[i] decodes one level on access),
+// so keys are evaluated straight from the mapping.
+struct DPFKeyView {
+    struct Levels {
+        const unsigned char* scw;
+        const unsigned char* bits;
+        size_t n;
+        size_t size() const { return n; }
+        DPFLevel operator[](size_t i) const {
+            DPFLevel L;
+            std::memcpy(&L.scw, scw + 16 * i, 16);
+            size_t bl = 1 + 2 * i, br = 2 + 2 * i;
+            L.tL_cw = (bits[bl >> 3] >> (bl & 7)) & 1u;
+            L.tR_cw = (bits[br >> 3] >> (br & 7)) & 1u;
+            L.keep_is_left = false;
+            return L;
+        }
+    };
+
+    uint128_t root_seed;
+    bool root_flag;
+    uint128_t final_cw;
+    uint32_t out_bits;
+    Levels levels;
+
+    DPFKeyView(const unsigned char* rec, uint32_t depth, uint32_t bits_per_output) {
+        std::memcpy(&root_seed, rec, 16);
+        std::memcpy(&final_cw, rec + 16, 16);
+        levels = Levels{rec + 32, rec + 32 + 16 * (size_t)depth, depth};
+        root_flag = levels.bits[0] & 1u;
+        out_bits = bits_per_output;
+    }
+};
+
+// Writes num_keys records through a shared writable mapping; record(i) may be
+// filled from any thread.
+class KeyFileWriter {
+public:
+    KeyFileWriter(const std::string& path, uint32_t party, uint64_t dpf_size, uint64_t num_keys,
+                  uint32_t depth, uint32_t out_bits, PRGBackend prg) {
+        KeyFileHeader h{};
+        std::memcpy(h.magic, KEYFILE_MAGIC, sizeof(h.magic));
+        h.version = KEYFILE_VERSION;
+        h.party = party;
+        h.dpf_size = dpf_size;
+        h.num_keys = num_keys;
+        h.depth = depth;
+        h.out_bits = out_bits;
+        h.prg = static_cast<uint32_t>(prg);
+        h.record_size = static_cast<uint32_t>(key_record_size(depth));
+        record_size_ = h.record_size;
+        len_ = sizeof(h) + num_keys * record_size_;
+
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd_ < 0) throw std::runtime_error("cannot create " + path);
+        if (::ftruncate(fd_, (off_t)len_) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("ftruncate failed for " + path);
+        }
+        void* p = ::mmap(nullptr, len_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("mmap failed for " + path);
+        }
+        base_ = static_cast<unsigned char*>(p);
+        std::memcpy(base_, &h, sizeof(h));
+    }
+
+    ~KeyFileWriter() {
+        ::munmap(base_, len_);
+        ::close(fd_);
+    }
+
+    KeyFileWriter(const KeyFileWriter&) = delete;
+    KeyFileWriter& operator=(const KeyFileWriter&) = delete;
+
+    void write(uint64_t i, const DPFKey& key) {
+        if (key.kind != DPFKind::Tree) throw std::invalid_argument("key files hold tree keys only");
+        encode_key_record(key, base_ + sizeof(KeyFileHeader) + i * record_size_, record_size_);
+    }
+
+    size_t bytes() const { return len_; }
+
+private:
+    int fd_ = -1;
+    unsigned char* base_ = nullptr;
+    size_t len_ = 0;
+    size_t record_size_ = 0;
+};
+
+// Maps a key file read-only and hands out views into it.
+class KeyFile {
+public:
+    explicit KeyFile(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || (size_t)st.st_size < sizeof(KeyFileHeader)) {
+            ::close(fd_);
+            throw std::runtime_error("not a key file: " + path);
+        }
+        len_ = (size_t)st.st_size;
+        void* p = ::mmap(nullptr, len_, PROT_READ, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd_);
+            throw std::runtime_error("mmap failed for " + path);
+        }
+        base_ = static_cast<const unsigned char*>(p);
+        std::memcpy(&h_, base_, sizeof(h_));
+        if (std::memcmp(h_.magic, KEYFILE_MAGIC, sizeof(h_.magic)) != 0 || h_.version != KEYFILE_VERSION ||
+            h_.record_size != key_record_size(h_.depth) || h_.prg != static_cast<uint32_t>(g_prg_backend) ||
+            len_ < sizeof(KeyFileHeader) + h_.num_keys * h_.record_size) {
+            ::munmap(const_cast<unsigned char*>(base_), len_);
+            ::close(fd_);
+            throw std::runtime_error("bad key file header: " + path);
+        }
+    }
+
+    ~KeyFile() {
+        ::munmap(const_cast<unsigned char*>(base_), len_);
+        ::close(fd_);
+    }
+
+    KeyFile(const KeyFile&) = delete;
+    KeyFile& operator=(const KeyFile&) = delete;
+
+    const KeyFileHeader& header() const { return h_; }
+    uint64_t size() const { return h_.num_keys; }
+    size_t bytes() const { return len_; }
+
+    DPFKeyView key(uint64_t i) const {
+        return DPFKeyView(base_ + sizeof(KeyFileHeader) + i * h_.record_size, h_.depth, h_.out_bits);
+    }
+
+private:
+    int fd_ = -1;
+    const unsigned char* base_ = nullptr;
+    size_t len_ = 0;
+    KeyFileHeader h_;
+};
@@ -0,0 +1,283 @@
+#pragma once
+#include <openssl/evp.h>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#if defined(__AES__) && defined(__SSE2__)
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#define GQ_HAVE_AESNI 1
+#endif
+
+using uint128_t = __uint128_t;
+
+struct PRGSingle {
+    uint128_t s;
+    bool t;
+};
+
+// Which length-doubling PRG the DPF tree uses. Keys are only valid under the
+// backend they were generated with.
+enum class PRGBackend { AES, SHA256 };
+
+inline PRGBackend g_prg_backend = PRGBackend::AES;
+
+inline const char* prg_backend_name(PRGBackend b) {
+    return b == PRGBackend::AES ? "aes" : "sha256";
+}
+
+inline PRGBackend parse_prg_backend(const std::string& s) {
+    if (s == "aes") return PRGBackend::AES;
+    if (s == "sha256") return PRGBackend::SHA256;
+    throw std::invalid_argument("unknown PRG backend: " + s);
+}
+
+inline std::array<unsigned char,16> u128_to_bytes_be(uint128_t x) {
+    std::array<unsigned char,16> b;
+    for (int i = 15; i >= 0; --i) {
+        b[i] = static_cast<unsigned char>(x & 0xFFu);
+        x >>= 8;
+    }
+    return b;
+}
+
+inline uint128_t bytes_be_to_u128(const unsigned char *buf) {
+    uint128_t x = 0;
+    for (int i = 0; i < 16; ++i) {
+        x <<= 8;
+        x |= static_cast<uint128_t>(buf[i]);
+    }
+    return x;
+}
+
+// ---------------------------------------------------------------------------
+// SHA-256 reference backend: child = SHA256(seed_be || bit)[0..16)
+// ---------------------------------------------------------------------------
+inline PRGSingle prg_expand_bit_sha256(uint128_t seed, unsigned char bit) {
+    std::array<unsigned char,17> in;
+    auto sbytes = u128_to_bytes_be(seed);
+    std::copy(sbytes.begin(), sbytes.end(), in.begin());
+    in[16] = bit; // domain separation by bit (0=left,1=right)
+
+    unsigned char digest[32];
+    unsigned int digest_len = 0;
+
+    // One digest context per thread, reset with EVP_DigestInit_ex on every use
+    thread_local struct MdCtx {
+        EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+        ~MdCtx() { EVP_MD_CTX_free(ctx); }
+    } md;
+    if (md.ctx == nullptr) throw std::runtime_error("EVP_MD_CTX_new failed");
+    if (1 != EVP_DigestInit_ex(md.ctx, EVP_sha256(), NULL)) {
+        throw std::runtime_error("EVP_DigestInit_ex failed");
+    }
+    if (1 != EVP_DigestUpdate(md.ctx, in.data(), in.size())) {
+        throw std::runtime_error("EVP_DigestUpdate failed");
+    }
+    if (1 != EVP_DigestFinal_ex(md.ctx, digest, &digest_len)) {
+        throw std::runtime_error("EVP_DigestFinal_ex failed");
+    }
+
+    PRGSingle out;
+    out.s = bytes_be_to_u128(digest);
+    out.t = static_cast<bool>(out.s & 1u);
+    return out;
+}
+
+// ---------------------------------------------------------------------------
+// Fixed-key AES backend (Matyas-Meyer-Oseas):
+//   left  = AES_{K0}(s) ^ s
+//   right = AES_{K1}(s) ^ s
+// Seeds are fed to AES as their native little-endian bytes, so no byte swaps
+// happen on the hot path. Both children come out of one interleaved pass.
+// ---------------------------------------------------------------------------
+inline constexpr unsigned char PRG_AES_KEY_L[16] = {
+    0x24, 0x3f, 0x6a, 0x88, 0x85, 0xa3, 0x08, 0xd3,
+    0x13, 0x19, 0x8a, 0x2e, 0x03, 0x70, 0x73, 0x44
+};
+inline constexpr unsigned char PRG_AES_KEY_R[16] = {
+    0xa4, 0x09, 0x38, 0x22, 0x29, 0x9f, 0x31, 0xd0,
+    0x08, 0x2e, 0xfa, 0x98, 0xec, 0x4e, 0x6c, 0x89
+};
+
+#ifdef GQ_HAVE_AESNI
+
+struct AESRoundKeys {
+    __m128i rk[11];
+};
+
+inline __m128i aes_key_step(__m128i key, __m128i gen) {
+    gen = _mm_shuffle_epi32(gen, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return _mm_xor_si128(key, gen);
+}
+
+inline AESRoundKeys aes_expand_key(const unsigned char* key) {
+    AESRoundKeys k;
+    k.rk[0]  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+    k.rk[1]  = aes_key_step(k.rk[0], _mm_aeskeygenassist_si128(k.rk[0], 0x01));
+    k.rk[2]  = aes_key_step(k.rk[1], _mm_aeskeygenassist_si128(k.rk[1], 0x02));
+    k.rk[3]  = aes_key_step(k.rk[2], _mm_aeskeygenassist_si128(k.rk[2], 0x04));
+    k.rk[4]  = aes_key_step(k.rk[3], _mm_aeskeygenassist_si128(k.rk[3], 0x08));
+    k.rk[5]  = aes_key_step(k.rk[4], _mm_aeskeygenassist_si128(k.rk[4], 0x10));
+    k.rk[6]  = aes_key_step(k.rk[5], _mm_aeskeygenassist_si128(k.rk[5], 0x20));
+    k.rk[7]  = aes_key_step(k.rk[6], _mm_aeskeygenassist_si128(k.rk[6], 0x40));
+    k.rk[8]  = aes_key_step(k.rk[7], _mm_aeskeygenassist_si128(k.rk[7], 0x80));
+    k.rk[9]  = aes_key_step(k.rk[8], _mm_aeskeygenassist_si128(k.rk[8], 0x1b));
+    k.rk[10] = aes_key_step(k.rk[9], _mm_aeskeygenassist_si128(k.rk[9], 0x36));
+    return k;
+}
+
+inline const AESRoundKeys& prg_aes_keys_L() {
+    static const AESRoundKeys k = aes_expand_key(PRG_AES_KEY_L);
+    return k;
+}
+
+inline const AESRoundKeys& prg_aes_keys_R() {
+    static const AESRoundKeys k = aes_expand_key(PRG_AES_KEY_R);
+    return k;
+}
+
+inline void prg_expand_aes(uint128_t seed, PRGSingle& L, PRGSingle& R) {
+    const AESRoundKeys& kl = prg_aes_keys_L();
+    const AESRoundKeys& kr = prg_aes_keys_R();
+    __m128i s;
+    std::memcpy(&s, &seed, 16);
+    __m128i bl = _mm_xor_si128(s, kl.rk[0]);
+    __m128i br = _mm_xor_si128(s, kr.rk[0]);
+    for (int r = 1; r < 10; ++r) {
+        bl = _mm_aesenc_si128(bl, kl.rk[r]);
+        br = _mm_aesenc_si128(br, kr.rk[r]);
+    }
+    bl = _mm_xor_si128(_mm_aesenclast_si128(bl, kl.rk[10]), s);
+    br = _mm_xor_si128(_mm_aesenclast_si128(br, kr.rk[10]), s);
+    std::memcpy(&L.s, &bl, 16);
+    std::memcpy(&R.s, &br, 16);
+    L.t = static_cast<bool>(L.s & 1u);
+    R.t = static_cast<bool>(R.s & 1u);
+}
+
+// Four independent seeds per call: 8 AES blocks in flight hide the aesenc
+// latency that a single expansion leaves exposed.
+inline void prg_expand_aes_x4(const uint128_t* seeds, uint128_t* L, uint128_t* R) {
+    const AESRoundKeys& kl = prg_aes_keys_L();
+    const AESRoundKeys& kr = prg_aes_keys_R();
+    __m128i s[4], bl[4], br[4];
+#pragma GCC unroll 4
+    for (int k = 0; k < 4; ++k) {
+        s[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(seeds + k));
+        bl[k] = _mm_xor_si128(s[k], kl.rk[0]);
+        br[k] = _mm_xor_si128(s[k], kr.rk[0]);
+    }
+    for (int r = 1; r < 10; ++r) {
+#pragma GCC unroll 4
+        for (int k = 0; k < 4; ++k) {
+            bl[k] = _mm_aesenc_si128(bl[k], kl.rk[r]);
+            br[k] = _mm_aesenc_si128(br[k], kr.rk[r]);
+        }
+    }
+#pragma GCC unroll 4
+    for (int k = 0; k < 4; ++k) {
+        bl[k] = _mm_xor_si128(_mm_aesenclast_si128(bl[k], kl.rk[10]), s[k]);
+        br[k] = _mm_xor_si128(_mm_aesenclast_si128(br[k], kr.rk[10]), s[k]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(L + k), bl[k]);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(R + k), br[k]);
+    }
+}
+
+inline void prg_expand_aes_many(const uint128_t* seeds, size_t n, uint128_t* L, uint128_t* R) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) prg_expand_aes_x4(seeds + i, L + i, R + i);
+    for (; i < n; ++i) {
+        PRGSingle l, r;
+        prg_expand_aes(seeds[i], l, r);
+        L[i] = l.s;
+        R[i] = r.s;
+    }
+}
+
+#else
+
+// Portable fallback through OpenSSL's AES-128-ECB; produces the same output
+// as the AES-NI path, just slower.
+struct AESEcbCtx {
+    EVP_CIPHER_CTX* ctx = nullptr;
+    explicit AESEcbCtx(const unsigned char* key) {
+        ctx = EVP_CIPHER_CTX_new();
+        if (ctx == nullptr ||
+            1 != EVP_EncryptInit_ex(ctx, EVP_aes_128_ecb(), NULL, key, NULL)) {
+            throw std::runtime_error("EVP_EncryptInit_ex failed");
+        }
+        EVP_CIPHER_CTX_set_padding(ctx, 0);
+    }
+    ~AESEcbCtx() { EVP_CIPHER_CTX_free(ctx); }
+    uint128_t encrypt(uint128_t x) {
+        unsigned char in[16], out[16];
+        int len = 0;
+        std::memcpy(in, &x, 16);
+        if (1 != EVP_EncryptUpdate(ctx, out, &len, in, 16)) {
+            throw std::runtime_error("EVP_EncryptUpdate failed");
+        }
+        uint128_t y;
+        std::memcpy(&y, out, 16);
+        return y;
+    }
+    void encrypt_many(const uint128_t* in, size_t n, uint128_t* out) {
+        int len = 0;
+        if (1 != EVP_EncryptUpdate(ctx, reinterpret_cast<unsigned char*>(out), &len,
+                                   reinterpret_cast<const unsigned char*>(in), static_cast<int>(16 * n))) {
+            throw std::runtime_error("EVP_EncryptUpdate failed");
+        }
+    }
+};
+
+inline void prg_expand_aes(uint128_t seed, PRGSingle& L, PRGSingle& R) {
+    thread_local AESEcbCtx cl(PRG_AES_KEY_L);
+    thread_local AESEcbCtx cr(PRG_AES_KEY_R);
+    L.s = cl.encrypt(seed) ^ seed;
+    R.s = cr.encrypt(seed) ^ seed;
+    L.t = static_cast<bool>(L.s & 1u);
+    R.t = static_cast<bool>(R.s & 1u);
+}
+
+inline void prg_expand_aes_many(const uint128_t* seeds, size_t n, uint128_t* L, uint128_t* R) {
+    thread_local AESEcbCtx cl(PRG_AES_KEY_L);
+    thread_local AESEcbCtx cr(PRG_AES_KEY_R);
+    cl.encrypt_many(seeds, n, L);
+    cr.encrypt_many(seeds, n, R);
+    for (size_t i = 0; i < n; ++i) {
+        L[i] ^= seeds[i];
+        R[i] ^= seeds[i];
+    }
+}
+
+#endif
+
+// Expand one node into both children with the selected backend
+inline void prg_expand(uint128_t seed, PRGSingle& L, PRGSingle& R) {
+    if (g_prg_backend == PRGBackend::AES) {
+        prg_expand_aes(seed, L, R);
+    } else {
+        L = prg_expand_bit_sha256(seed, 0);
+        R = prg_expand_bit_sha256(seed, 1);
+    }
+}
+
+// Expand n independent seeds; L[i]/R[i] receive the children of seeds[i] and
+// the control bit of each child is its lowest bit. The outputs must not
+// overlap seeds.
+inline void prg_expand_many(const uint128_t* seeds, size_t n, uint128_t* L, uint128_t* R) {
+    if (g_prg_backend == PRGBackend::AES) {
+        prg_expand_aes_many(seeds, n, L, R);
+        return;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        L[i] = prg_expand_bit_sha256(seeds[i], 0).s;
+        R[i] = prg_expand_bit_sha256(seeds[i], 1).s;
+    }
+}
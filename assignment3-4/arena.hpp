@@ -0,0 +1,147 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <linux/mempolicy.h>
+#include <linux/mman.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "dpf.h"
+#include "thread_pool.hpp"
+
+namespace cs670 {
+
+enum class PageSize { Base, Huge2M, Huge1G };
+
+struct ArenaOptions {
+    PageSize pages = PageSize::Huge2M;  // largest page size to try
+    bool interleave = false;            // spread pages over all NUMA nodes instead of first touch
+};
+
+// Share array from its own anonymous mapping, for the N * d buffers a server
+// updates in place. Unlike std::vector<FieldT>(n) nothing is zeroed in user
+// space (fresh anonymous pages read as zero). Pages come from hugetlbfs (1G
+// or 2M, if the system has them reserved), else from base pages advised for
+// transparent huge pages. Given a pool, each page is first touched by the
+// task that owns its chunk range in the pool's EvalFullAccumulate split, so
+// with first-touch placement it lands on that worker's NUMA node.
+class ShareBuffer {
+public:
+    ShareBuffer() = default;
+
+    explicit ShareBuffer(size_t words, ArenaOptions opt = {}, WorkStealingPool* pool = nullptr)
+        : words_(words)
+    {
+        size_t want = words * sizeof(FieldT);
+        if (want == 0) return;
+        if (opt.pages == PageSize::Huge1G) map_hugetlb(want, 1ULL << 30, MAP_HUGE_1GB, "hugetlb-1G");
+        if (!base_ && opt.pages != PageSize::Base) map_hugetlb(want, 1ULL << 21, MAP_HUGE_2MB, "hugetlb-2M");
+        if (!base_) map_base(want, opt.pages != PageSize::Base);
+        if (opt.interleave) interleave();
+        if (pool) first_touch(*pool);
+    }
+
+    ShareBuffer(ShareBuffer&& o) noexcept
+        : base_(std::exchange(o.base_, nullptr)), bytes_(o.bytes_), words_(std::exchange(o.words_, 0)),
+          backing_(o.backing_) {}
+    ShareBuffer& operator=(ShareBuffer&& o) noexcept {
+        std::swap(base_, o.base_);
+        std::swap(bytes_, o.bytes_);
+        std::swap(words_, o.words_);
+        std::swap(backing_, o.backing_);
+        return *this;
+    }
+    ShareBuffer(const ShareBuffer&) = delete;
+    ShareBuffer& operator=(const ShareBuffer&) = delete;
+
+    ~ShareBuffer() {
+        if (base_) ::munmap(base_, bytes_);
+    }
+
+    FieldT* data() { return static_cast<FieldT*>(base_); }
+    const FieldT* data() const { return static_cast<const FieldT*>(base_); }
+    size_t size() const { return words_; }
+    FieldT& operator[](size_t i) { return data()[i]; }
+    const FieldT& operator[](size_t i) const { return data()[i]; }
+    FieldT* begin() { return data(); }
+    FieldT* end() { return data() + words_; }
+
+    operator std::span<FieldT>() { return {data(), words_}; }
+    operator std::span<const FieldT>() const { return {data(), words_}; }
+
+    // "hugetlb-1G", "hugetlb-2M", "thp" (advised) or "4k"
+    const char* backing() const { return backing_; }
+
+private:
+    void map_hugetlb(size_t want, size_t page, int size_flag, const char* name) {
+        size_t bytes = (want + page - 1) / page * page;
+        void* p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | size_flag, -1, 0);
+        if (p == MAP_FAILED) return;
+        base_ = p;
+        bytes_ = bytes;
+        backing_ = name;
+    }
+
+    // 2M-aligned, so THP can back the whole range
+    void map_base(size_t want, bool thp) {
+        constexpr size_t ALIGN = 1ULL << 21;
+        size_t bytes = (want + 4095) / 4096 * 4096;
+        void* p = ::mmap(nullptr, bytes + ALIGN, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::runtime_error(std::string("mmap share buffer: ") + std::strerror(errno));
+        uintptr_t lo = (uintptr_t)p, start = (lo + ALIGN - 1) & ~(uintptr_t)(ALIGN - 1);
+        if (start > lo) ::munmap(p, start - lo);
+        ::munmap((void*)(start + bytes), ALIGN - (start - lo));
+        base_ = (void*)start;
+        bytes_ = bytes;
+        backing_ = "4k";
+        if (thp && ::madvise(base_, bytes_, MADV_HUGEPAGE) == 0) backing_ = "thp";
+    }
+
+    // MPOL_INTERLEAVE over the online nodes; a hint, ignored where mbind is
+    // unavailable
+    void interleave() {
+        std::ifstream in("/sys/devices/system/node/online");
+        unsigned long mask = 0;
+        unsigned lo, hi;
+        char sep;
+        while (in >> lo) {
+            hi = lo;
+            if (in.peek() == '-') in >> sep >> hi;
+            for (unsigned n = lo; n <= hi && n < 64; n++) mask |= 1UL << n;
+            if (in.peek() == ',') in >> sep;
+        }
+        if (mask != 0) ::syscall(SYS_mbind, base_, bytes_, MPOL_INTERLEAVE, &mask, 64, 0);
+    }
+
+    // Same split as run_chunk_tasks: 8 contiguous ranges per worker
+    void first_touch(WorkStealingPool& pool) {
+        size_t pages = bytes_ / 4096, tasks = std::min<size_t>(pages, 8 * pool.size());
+        volatile char* b = static_cast<char*>(base_);
+        pool.run(tasks, [&](size_t k) {
+            for (size_t pg = k * pages / tasks; pg < (k + 1) * pages / tasks; pg++) b[pg * 4096] = 0;
+        });
+    }
+
+    void* base_ = nullptr;
+    size_t bytes_ = 0;
+    size_t words_ = 0;
+    const char* backing_ = "none";
+};
+
+// The 2^tree_height * vector_dim share array, zero on allocation
+inline ShareBuffer alloc_share_flat(uint32_t tree_height, uint32_t vector_dim, ArenaOptions opt = {},
+                                    WorkStealingPool* pool = nullptr) {
+    return ShareBuffer(domain_size_from_height(tree_height) * vector_dim, opt, pool);
+}
+
+}
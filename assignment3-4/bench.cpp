@@ -1,5 +1,9 @@
 #include "dpf.h"
 #include "conversion.h"
+#include "csprng.hpp"
+#include "thread_pool.hpp"
+#include "epoch.hpp"
+#include "arena.hpp"
 
 #include <iostream>
 #include <vector>
@@ -7,6 +11,15 @@
 #include <random>
 #include <cstring>
 #include <cassert>
+#include <cmath>
+#include <tuple>
+#include <algorithm>
+#include <thread>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 using namespace cs670;
 
@@ -16,6 +29,17 @@ struct BenchArgs {
     uint32_t vector_dim = 4;
     uint32_t tree_height = 10;  
     uint32_t runs = 30; 
+    uint32_t max_height = 0;    // > 0: sweep N = 2^10, 2^12, .. 2^max_height instead of the item list
+    uint32_t chunk_log = DEFAULT_CHUNK_LOG;    // EvalFull leaves per streamed chunk = 2^chunk_log
+    bool stream = false;        // stream a 2^height checksum over chunk sizes instead
+    bool prg = false;           // CtrPrg bulk-fill throughput instead
+    uint32_t threads = 1;       // pool size for the secure update
+    bool scaling = false;       // thread-scaling sweep instead
+    uint32_t epoch = 0;         // > 0: K = 1, 2, 4 .. epoch updates one by one vs. as one epoch
+    bool kernels = false;       // specialized vs. generic leaf kernels per vector_dim instead
+    bool fetch = false;         // private fetch (inner product) vs. update scan rates instead
+    bool arena = false;         // vector vs. ShareBuffer vs. streaming stores for the update instead
+    bool convert = false;       // networked conversion of a 2^height * dim vector per chunk size instead
 };
 
 static BenchArgs parse_args(int argc, char** argv) {
@@ -25,6 +49,17 @@ static BenchArgs parse_args(int argc, char** argv) {
         else if (!strcmp(argv[i], "--dim") && i + 1 < argc) a.vector_dim = std::stoul(argv[++i]);
         else if (!strcmp(argv[i], "--runs") && i + 1 < argc) a.runs = std::stoul(argv[++i]);
         else if (!strcmp(argv[i], "--height") && i + 1 < argc) a.tree_height = std::stoul(argv[++i]);
+        else if (!strcmp(argv[i], "--max-height") && i + 1 < argc) a.max_height = std::stoul(argv[++i]);
+        else if (!strcmp(argv[i], "--chunk-log") && i + 1 < argc) a.chunk_log = std::stoul(argv[++i]);
+        else if (!strcmp(argv[i], "--stream")) a.stream = true;
+        else if (!strcmp(argv[i], "--prg")) a.prg = true;
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) a.threads = std::stoul(argv[++i]);
+        else if (!strcmp(argv[i], "--scaling")) a.scaling = true;
+        else if (!strcmp(argv[i], "--epoch") && i + 1 < argc) a.epoch = std::stoul(argv[++i]);
+        else if (!strcmp(argv[i], "--kernels")) a.kernels = true;
+        else if (!strcmp(argv[i], "--fetch")) a.fetch = true;
+        else if (!strcmp(argv[i], "--arena")) a.arena = true;
+        else if (!strcmp(argv[i], "--convert")) a.convert = true;
     }
     return a;
 }
@@ -61,8 +96,11 @@ void bench_update(const BenchArgs& args) {
 
     std::mt19937_64 rng(std::random_device{}());
 
+    WorkStealingPool pool(args.threads);
+
     // Prepare statistics
     std::vector<uint64_t> secure_times, user_times;
+    size_t key_bytes = 0;
 
     for (uint32_t run = 0; run < args.runs; run++) {
         // Random index for update
@@ -72,17 +110,20 @@ void bench_update(const BenchArgs& args) {
 
         // --- Secure item update timing (DPF EvalFull) ---
         
-        auto keys = Gen_point_zero(j, height, dim, rng);
+        auto keys = Gen_point_zero(j, height, dim);
+        key_bytes = keys.first.serialize().size();
         
         std::vector<FieldT> fcw(dim);
         for (uint32_t d = 0; d < dim; d++) fcw[d] = u[d]; 
         keys.first.fcw = fcw;
         keys.second.fcw = fcw;
 
-        // Time DPF EvalFull
+        // Time both servers' in-place update V_b += EvalFull(k_b)
+        // Sized to the real item count: leaves past N are pruned, not evaluated
+        ShareBuffer V0(N * dim, {}, &pool), V1(N * dim, {}, &pool);
         auto start_secure = std::chrono::high_resolution_clock::now();
-        std::vector<FieldT> D0 = EvalFull(keys.first);
-        std::vector<FieldT> D1 = EvalFull(keys.second);
+        EvalFullAccumulate(keys.first, V0, 1, pool, args.chunk_log);
+        EvalFullAccumulate(keys.second, V1, 1, pool, args.chunk_log);
         auto end_secure = std::chrono::high_resolution_clock::now();
         uint64_t secure_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end_secure - start_secure).count();
         secure_times.push_back(secure_ns);
@@ -116,16 +157,373 @@ void bench_update(const BenchArgs& args) {
     // Output CSV row
     std::cout << N << "," << args.vector_dim << "," << args.runs << ","
               << s_avg << "," << s_min << "," << s_max << "," << s_std << ","
-              << u_avg << "," << u_min << "," << u_max << "," << u_std << "\n";
+              << u_avg << "," << u_min << "," << u_max << "," << u_std << "," << key_bytes << ","
+              << (1ULL << std::min(height, args.chunk_log)) << "\n";
+}
+
+// ---------------------------
+// Constant-memory streaming pass over a 2^height domain (may exceed RAM as a
+// flat array): one server's EvalFull folded into a checksum, per chunk size
+// ---------------------------
+void bench_stream(const BenchArgs& args) {
+    auto keys = Gen_point_zero(0, args.tree_height, args.vector_dim);
+    for (uint32_t chunk_log = 6; chunk_log <= 16 && chunk_log <= args.tree_height; chunk_log += 2) {
+        EvalFullStream stream(keys.first, chunk_log);
+        EvalChunk chunk;
+        uint64_t checksum = 0;
+        auto start = std::chrono::high_resolution_clock::now();
+        while (stream.next(chunk)) {
+            for (FieldT v : chunk.values) checksum += (uint64_t)v;
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        std::cout << (1ULL << args.tree_height) << "," << args.vector_dim << "," << stream.chunk_items() << ","
+                  << ns << "," << (double)(1ULL << args.tree_height) * 1e9 / ns << "," << checksum << "\n";
+    }
+}
+
+// ---------------------------
+// CtrPrg throughput: sequential bulk fill of buffers from 4 KiB to 16 MiB,
+// and the same stream rebuilt from 8 out-of-order slices as a check
+// ---------------------------
+void bench_prg(const BenchArgs& args) {
+    unsigned char key[16] = {};
+    CtrPrg prg(key);
+    for (size_t bytes = 4096; bytes <= (16u << 20); bytes *= 16) {
+        std::vector<uint64_t> buf(bytes / 8), sliced(bytes / 8);
+        uint64_t best = UINT64_MAX;
+        for (uint32_t run = 0; run < args.runs; run++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            prg.seek(0);
+            prg.fill(std::span<uint64_t>(buf));
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min<uint64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        size_t slice = sliced.size() / 8;
+        for (size_t k = 8; k-- > 0;) {
+            prg.fill(std::span<uint64_t>(sliced).subspan(k * slice, slice), k * slice);
+        }
+        std::cout << bytes << "," << best << "," << (double)bytes / best << ","
+                  << (sliced == buf ? "yes" : "NO") << "\n";
+    }
+}
+
+// ---------------------------
+// Thread scaling of one server's in-place update, N = 2^20 .. 2^26 (or up to
+// --max-height), pool sizes 1 .. 64; best of --runs
+// ---------------------------
+void bench_scaling(const BenchArgs& args) {
+    uint32_t max_h = args.max_height > 0 ? args.max_height : 26;
+    for (uint32_t h = 20; h <= max_h; h += 2) {
+        auto keys = Gen_point_zero(0, h, args.vector_dim);
+        ShareBuffer V = alloc_share_flat(h, args.vector_dim);
+        double base = 0;
+        for (unsigned th = 1; th <= 64; th *= 2) {
+            WorkStealingPool pool(th);
+            uint64_t best = UINT64_MAX;
+            for (uint32_t run = 0; run < args.runs; run++) {
+                auto start = std::chrono::high_resolution_clock::now();
+                EvalFullAccumulate(keys.first, V, 1, pool, args.chunk_log);
+                auto end = std::chrono::high_resolution_clock::now();
+                best = std::min<uint64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+            if (th == 1) base = (double)best;
+            std::cout << (1ULL << h) << "," << args.vector_dim << "," << th << "," << best << ","
+                      << base / best << "\n";
+        }
+    }
+}
+
+// ---------------------------
+// K updates to one server's 2^height DB applied one pass each vs. as one
+// epoch (one pass total); best of --runs, both must give the same DB
+// ---------------------------
+void bench_epoch(const BenchArgs& args) {
+    WorkStealingPool pool(args.threads);
+    for (uint32_t K = 1; K <= args.epoch; K *= 2) {
+        std::vector<DPFKey> keys;
+        for (uint32_t k = 0; k < K; k++) {
+            auto kp = Gen_point_zero(k % (1ULL << args.tree_height), args.tree_height, args.vector_dim);
+            keys.push_back(kp.first);
+        }
+        ShareBuffer V_one = alloc_share_flat(args.tree_height, args.vector_dim, {}, &pool);
+        ShareBuffer V_epoch = alloc_share_flat(args.tree_height, args.vector_dim, {}, &pool);
+        uint64_t one_ns = UINT64_MAX, epoch_ns = UINT64_MAX;
+        for (uint32_t run = 0; run < args.runs; run++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            for (const DPFKey& key : keys) EvalFullAccumulate(key, V_one, 1, pool, args.chunk_log);
+            auto mid = std::chrono::high_resolution_clock::now();
+            UpdateEpoch epoch(V_epoch, K, std::chrono::seconds(1), &pool);
+            for (const DPFKey& key : keys) epoch.submit(key);
+            epoch.flush();
+            auto end = std::chrono::high_resolution_clock::now();
+            one_ns = std::min<uint64_t>(one_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(mid - start).count());
+            epoch_ns = std::min<uint64_t>(epoch_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(end - mid).count());
+        }
+        std::cout << (1ULL << args.tree_height) << "," << args.vector_dim << "," << K << "," << one_ns << ","
+                  << epoch_ns << "," << (double)one_ns / epoch_ns << ","
+                  << (std::equal(V_one.begin(), V_one.end(), V_epoch.begin()) ? "yes" : "NO") << "\n";
+    }
+}
+
+// ---------------------------
+// One server's in-place update on a 2^height DB with the dimension-specialized
+// kernels vs. the generic ones, for dims 2 .. 64 and one dim without a
+// specialization; best of --runs, both must give the same DB
+// ---------------------------
+void bench_kernels(const BenchArgs& args) {
+    for (uint32_t dim : {2u, 4u, 8u, 16u, 32u, 64u, 5u}) {
+        auto keys = Gen_point_zero(0, args.tree_height, dim);
+        ShareBuffer V_spec = alloc_share_flat(args.tree_height, dim), V_gen = alloc_share_flat(args.tree_height, dim);
+        uint64_t best[2] = {UINT64_MAX, UINT64_MAX};
+        for (uint32_t run = 0; run < args.runs; run++) {
+            for (int generic = 0; generic < 2; generic++) {
+                use_generic_kernels(generic);
+                auto start = std::chrono::high_resolution_clock::now();
+                EvalFullAccumulate(keys.first, generic ? V_gen : V_spec, 1, args.chunk_log);
+                auto end = std::chrono::high_resolution_clock::now();
+                best[generic] = std::min<uint64_t>(best[generic], std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+        }
+        use_generic_kernels(false);
+        std::cout << (1ULL << args.tree_height) << "," << dim << "," << best[0] << "," << best[1] << ","
+                  << (double)best[1] / best[0] << ","
+                  << (std::equal(V_spec.begin(), V_spec.end(), V_gen.begin()) ? "yes" : "NO") << "\n";
+    }
+}
+
+// ---------------------------
+// Read vs. write path on one server, N = 2^10 .. 2^height (step 2): a private
+// fetch (EvalInnerProduct over a replicated table) and an in-place update, both on a
+// pool of --threads, in items scanned per second; best of --runs. The last
+// column checks that the two servers' answers sum to the fetched item.
+// ---------------------------
+void bench_fetch(const BenchArgs& args) {
+    WorkStealingPool pool(args.threads);
+    uint32_t dim = args.vector_dim;
+    unsigned char key[16] = {};
+    CtrPrg prg(key);
+    for (uint32_t h = 10; h <= args.tree_height; h += 2) {
+        uint64_t N = 1ULL << h, j = N / 3;
+        ShareBuffer V = alloc_share_flat(h, dim, {}, &pool);
+        prg.fill(std::span<FieldT>(V), 0);
+        auto rk = Gen_point_read(j, h);
+        auto wk = Gen_point_zero(j, h, dim);
+        uint64_t read_ns = UINT64_MAX, write_ns = UINT64_MAX;
+        std::vector<FieldT> a0;
+        for (uint32_t run = 0; run < args.runs; run++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            a0 = EvalInnerProduct(rk.first, V, dim, pool, args.chunk_log);
+            auto mid = std::chrono::high_resolution_clock::now();
+            EvalFullAccumulate(wk.first, V, 1, pool, args.chunk_log);
+            auto end = std::chrono::high_resolution_clock::now();
+            EvalFullAccumulate(wk.first, V, -1, pool, args.chunk_log);
+            read_ns = std::min<uint64_t>(read_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(mid - start).count());
+            write_ns = std::min<uint64_t>(write_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(end - mid).count());
+        }
+        std::vector<FieldT> a1 = EvalInnerProduct(rk.second, V, dim, pool, args.chunk_log);
+        bool ok = true;
+        for (uint32_t d = 0; d < dim; d++)
+            if ((uint64_t)a0[d] + (uint64_t)a1[d] != (uint64_t)V[j * dim + d]) ok = false;
+        std::cout << N << "," << dim << "," << args.threads << "," << read_ns << "," << (double)N * 1e9 / read_ns
+                  << "," << write_ns << "," << (double)N * 1e9 / write_ns << "," << (ok ? "yes" : "NO") << "\n";
+    }
+}
+
+// dTLB load misses of this process, counted between start() and stop()
+// (threads created after construction included); -1 where perf events are
+// not permitted
+class TlbCounter {
+public:
+    TlbCounter() {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~TlbCounter() {
+        if (fd_ >= 0) close(fd_);
+    }
+    void start() {
+        if (fd_ >= 0) ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    void stop() {
+        if (fd_ >= 0) ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+    }
+    // Read once the counted threads have exited
+    int64_t misses() const {
+        uint64_t v;
+        if (fd_ < 0 || read(fd_, &v, sizeof(v)) != sizeof(v)) return -1;
+        return (int64_t)v;
+    }
+
+private:
+    int fd_;
+};
+
+// ---------------------------
+// One server's update of a 2^height share array, allocated as a value-
+// initialized std::vector, as a ShareBuffer (huge pages, first touch by the
+// pool) and as a ShareBuffer updated with streaming stores: allocation time,
+// best-of --runs update time, bandwidth over the array's read and write
+// traffic, and dTLB misses of the timed runs
+// ---------------------------
+void bench_arena(const BenchArgs& args) {
+    uint64_t words = ((uint64_t)1 << args.tree_height) * args.vector_dim;
+    auto keys = Gen_point_zero(0, args.tree_height, args.vector_dim);
+    for (int layout = 0; layout < 3; layout++) {
+        TlbCounter tlb;
+        uint64_t alloc_ns, best = UINT64_MAX;
+        const char* backing = "4k";
+        {
+            WorkStealingPool pool(args.threads);
+            auto start = std::chrono::high_resolution_clock::now();
+            std::vector<FieldT> vec;
+            ShareBuffer buf;
+            if (layout == 0) vec.resize(words);
+            else buf = ShareBuffer(words, {}, &pool);
+            auto end = std::chrono::high_resolution_clock::now();
+            alloc_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+            if (layout > 0) backing = buf.backing();
+            std::span<FieldT> V = layout == 0 ? std::span<FieldT>(vec) : std::span<FieldT>(buf);
+
+            use_streaming_stores(layout == 2);
+            tlb.start();
+            for (uint32_t run = 0; run < args.runs; run++) {
+                start = std::chrono::high_resolution_clock::now();
+                EvalFullAccumulate(keys.first, V, 1, pool, args.chunk_log);
+                end = std::chrono::high_resolution_clock::now();
+                best = std::min<uint64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            }
+            tlb.stop();
+            use_streaming_stores(false);
+        }
+        static const char* names[] = {"vector", "arena", "arena+nt"};
+        std::cout << (1ULL << args.tree_height) << "," << args.vector_dim << "," << names[layout] << ","
+                  << backing << "," << alloc_ns << "," << best << "," << 2.0 * words * sizeof(FieldT) / best << ","
+                  << tlb.misses() << "\n";
+    }
+}
+
+// ---------------------------
+// Networked XOR-to-additive conversion of a 2^height * vector_dim vector,
+// both parties in this process over loopback: best-of --runs wall time per
+// chunk size, with one chunk for the whole vector (no overlap) last, and the
+// link rate over the 8 bytes per word party 0 sends
+// ---------------------------
+void bench_convert(const BenchArgs& args) {
+    size_t words = ((size_t)1 << args.tree_height) * args.vector_dim;
+    ShareBuffer D0 = alloc_share_flat(args.tree_height, args.vector_dim);
+    ShareBuffer D1 = alloc_share_flat(args.tree_height, args.vector_dim);
+    ShareBuffer out0 = alloc_share_flat(args.tree_height, args.vector_dim);
+    ShareBuffer out1 = alloc_share_flat(args.tree_height, args.vector_dim);
+    csprng().fill(std::span<FieldT>(D0));
+    csprng().fill(std::span<FieldT>(D1));
+    boost::asio::io_context io;
+    auto [s0, s1] = loopback_pair(io);
+
+    std::vector<size_t> sizes;
+    for (size_t c = 1 << 10; c < words && c <= (1 << 18); c <<= 2) sizes.push_back(c);
+    sizes.push_back(std::min<size_t>(words, 1ULL << 27));
+    for (size_t chunk : sizes) {
+        uint64_t best = UINT64_MAX;
+        for (uint32_t run = 0; run < args.runs; run++) {
+            auto start = std::chrono::high_resolution_clock::now();
+            std::thread party1([&] { secure_xor_to_additive_net(s1, 1, D1, out1, chunk); });
+            secure_xor_to_additive_net(s0, 0, D0, out0, chunk);
+            party1.join();
+            auto end = std::chrono::high_resolution_clock::now();
+            best = std::min<uint64_t>(best, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        }
+        bool match = true;
+        for (size_t i = 0; i < words; i++)
+            if ((uint64_t)out0[i] + (uint64_t)out1[i] != (uint64_t)D0[i] + (uint64_t)D1[i]) match = false;
+        std::cout << words << "," << chunk << "," << best / 1e6 << "," << 8.0 * words * 1e3 / best << ","
+                  << (match ? "yes" : "NO") << "\n";
+    }
 }
 
 int main(int argc, char** argv) {
     BenchArgs args = parse_args(argc, argv);
 
+    if (args.convert) {
+        // e.g. --convert --height 20 --dim 8 --runs 3
+        std::cout << "words,chunk_words,convert_ms,MBps,match\n";
+        bench_convert(args);
+        return 0;
+    }
+
+    if (args.arena) {
+        // e.g. --arena --height 24 --dim 8 --threads 8 --runs 3
+        std::cout << "N,vector_dim,layout,backing,alloc_ns,update_ns,GBps,dtlb_misses\n";
+        bench_arena(args);
+        return 0;
+    }
+
+    if (args.fetch) {
+        // e.g. --fetch --height 22 --dim 4 --threads 8 --runs 3
+        std::cout << "N,vector_dim,threads,fetch_ns,fetch_items_per_s,update_ns,update_items_per_s,correct\n";
+        bench_fetch(args);
+        return 0;
+    }
+
+    if (args.kernels) {
+        // e.g. --kernels --height 16 --runs 5
+        std::cout << "N,vector_dim,specialized_ns,generic_ns,speedup,same_db\n";
+        bench_kernels(args);
+        return 0;
+    }
+
+    if (args.epoch > 0) {
+        // e.g. --epoch 64 --height 20 --dim 4 --runs 1
+        std::cout << "N,vector_dim,keys,per_update_passes_ns,epoch_ns,speedup,same_db\n";
+        bench_epoch(args);
+        return 0;
+    }
+
+    if (args.scaling) {
+        // e.g. --scaling --dim 4 --runs 3
+        std::cout << "N,vector_dim,threads,update_time_ns,speedup\n";
+        bench_scaling(args);
+        return 0;
+    }
+
+    if (args.prg) {
+        // e.g. --prg --runs 5
+        std::cout << "bytes,fill_time_ns,gb_per_sec,slices_match\n";
+        bench_prg(args);
+        return 0;
+    }
+
+    if (args.stream) {
+        // e.g. --stream --height 28 --dim 4
+        std::cout << "N,vector_dim,chunk_items,stream_time_ns,items_per_sec,checksum\n";
+        bench_stream(args);
+        return 0;
+    }
+
     // Output CSV header
-    std::cout << "N,vector_dim,runs,secure_time_ns_avg,secure_time_ns_min,secure_time_ns_max,secure_time_ns_stddev,user_time_ns_avg,user_time_ns_min,user_time_ns_max,user_time_ns_stddev\n";
+    std::cout << "N,vector_dim,runs,secure_time_ns_avg,secure_time_ns_min,secure_time_ns_max,secure_time_ns_stddev,user_time_ns_avg,user_time_ns_min,user_time_ns_max,user_time_ns_stddev,key_bytes,chunk_items\n";
     std::vector<uint64_t> N_values = {50, 100, 200, 300, 400, 500, 600, 700, 800, 900, 1000, 1200, 1500, 2000};
     std::vector<uint32_t> dims = {2, 4, 8};
+    if (args.max_height > 0) {
+        // Power-of-two domains with the given --runs, e.g. --max-height 24 --runs 3
+        for (auto dim : dims) {
+            args.vector_dim = dim;
+            for (uint32_t h = 10; h <= args.max_height; h += 2) {
+                args.num_items = 1ULL << h;
+                args.tree_height = h;
+                bench_update(args);
+            }
+        }
+        return 0;
+    }
     std::vector<uint32_t> runs_list = {20, 30, 50};
     for (auto dim : dims) {
         args.vector_dim = dim;
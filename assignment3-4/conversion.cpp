@@ -1,5 +1,8 @@
 #include "conversion.h"
+#include "csprng.hpp"
 #include <cassert>
+#include <span>
+#include <cstring>
 
 namespace cs670 {
 
@@ -60,13 +63,10 @@ void secure_xor_to_additive_beaver(
     out_share.resize(n);
 
     if (party_id == 0) {
-        
-        std::random_device rd;
-        std::mt19937_64 rng(rd());
+        // S0: one bulk draw from the thread's CSPRNG, kept non-negative
+        csprng().fill(std::span<FieldT>(out_share));
         for (size_t i = 0; i < n; i++) {
-            
-            FieldT S0 = (FieldT)(rng() & 0x7FFFFFFFFFFFFFFFLL);
-            out_share[i] = S0;
+            out_share[i] &= 0x7FFFFFFFFFFFFFFFLL;
         }
         
         if (mailbox_to_other) {
@@ -92,4 +92,63 @@ void secure_xor_to_additive_beaver(
     }
 }
 
-} 
+// ------------------------------------------------------------
+// Secure XOR→additive conversion between two processes, chunk-streamed
+// ------------------------------------------------------------
+
+void secure_xor_to_additive_net(
+    tcp::socket& peer,
+    int party_id,
+    std::span<const FieldT> D_b,
+    std::span<FieldT> out_share,
+    size_t chunk_words)
+{
+    const size_t n = D_b.size();
+    if (party_id != 0 && party_id != 1)
+        throw std::invalid_argument("secure_xor_to_additive_net: party_id must be 0 or 1");
+    if (out_share.size() != n)
+        throw std::invalid_argument("secure_xor_to_additive_net: out_share size differs from D_b");
+    if (chunk_words == 0 || chunk_words > (1ULL << 28))
+        throw std::invalid_argument("secure_xor_to_additive_net: chunk_words must be in [1, 2^28]");
+
+    std::vector<uint8_t> hello;
+    put_u64(hello, n);
+    put_u64(hello, chunk_words);
+    send_frame(peer, CONV_HELLO, hello);
+    Frame in = recv_frame(peer);
+    if (in.op != CONV_HELLO || in.payload != hello)
+        throw std::runtime_error("secure_xor_to_additive_net: peer has a different size or chunk size");
+
+    const size_t chunks = (n + chunk_words - 1) / chunk_words;
+    if (party_id == 0) {
+        // send_frame returns once the chunk is in the socket buffer, so the
+        // next chunk is masked while this one is on the wire. Words go out
+        // in host order, which is little-endian like put_u64.
+        std::vector<FieldT> msg(chunk_words);
+        for (size_t c = 0; c < chunks; c++) {
+            size_t lo = c * chunk_words, len = std::min(chunk_words, n - lo);
+            csprng().fill(std::span<FieldT>(msg.data(), len));
+            for (size_t i = 0; i < len; i++) {
+                uint64_t d = (uint64_t)D_b[lo + i], mask = (uint64_t)msg[i];
+                out_share[lo + i] = (FieldT)mask;
+                msg[i] = (FieldT)(d - mask);
+            }
+            send_frame(peer, CONV_CHUNK, {reinterpret_cast<const uint8_t*>(msg.data()), len * sizeof(FieldT)});
+        }
+    } else {
+        for (size_t c = 0; c < chunks; c++) {
+            size_t lo = c * chunk_words, len = std::min(chunk_words, n - lo);
+            recv_frame(peer, in);
+            if (in.op != CONV_CHUNK || in.payload.size() != len * sizeof(FieldT))
+                throw std::runtime_error("secure_xor_to_additive_net: malformed chunk from peer");
+            const uint8_t* p = in.payload.data();
+            for (size_t i = 0; i < len; i++) {
+                uint64_t w;
+                std::memcpy(&w, p + 8 * i, 8);
+                out_share[lo + i] = (FieldT)((uint64_t)D_b[lo + i] + w);
+            }
+        }
+    }
+}
+
+}
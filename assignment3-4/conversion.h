@@ -3,11 +3,15 @@
 
 #include <vector>
 #include <cstdint>
+#include <span>
 #include "dpf.h"
+#include "net.hpp"
 
 namespace cs670 {
 
-
+// Party 0 keeps its output, party 1 negates it. EvalFull no longer needs
+// either conversion (its leaves are additive shares already); these remain
+// for XOR-shared vectors.
 void baseline_xor_to_additive(
     const std::vector<FieldT>& D_b,
     int party_id,            
@@ -24,6 +28,27 @@ void secure_xor_to_additive_beaver(
     const std::vector<FieldT>* mailbox_from_other 
 );
 
+// Words per chunk of secure_xor_to_additive_net (128 KiB on the wire)
+constexpr size_t CONVERT_CHUNK_WORDS = 1 << 14;
+
+// secure_xor_to_additive_beaver between two processes over a connected
+// socket, with only the traffic the outputs depend on. In the mailbox
+// version party 0's share is S0 - R0 and party 1's is D1 + (M0 - S0) =
+// D1 + D0 - (S0 - R0), and M1 is never used. Here party 0 draws the mask
+// S = S0 - R0 from csprng() as one word, keeps it and sends D0 - S; party 1
+// adds that to D1. One word per item crosses the link, in one direction.
+// The vector is streamed in chunks, so each party holds O(chunk_words)
+// temporaries and party 0 masks chunk i + 1 while the socket drains chunk
+// i. The outputs sum to D_0 + D_1. out_share has D_b's size and may alias
+// it; both parties must pass the same size and chunk_words.
+void secure_xor_to_additive_net(
+    tcp::socket& peer,
+    int party_id,
+    std::span<const FieldT> D_b,
+    std::span<FieldT> out_share,
+    size_t chunk_words = CONVERT_CHUNK_WORDS
+);
+
 } 
 
 #endif 
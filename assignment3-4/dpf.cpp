@@ -1,48 +1,86 @@
 #include "dpf.h"
+#include "csprng.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
 #include <cstring>
+#include <memory>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace cs670 {
 
+// ------------------------------------------------------------
+// PRG: fixed-key AES in Matyas-Meyer-Oseas mode, H_K(x) = AES_K(x) ^ x.
+// K_L / K_R give the two children of a tree node (control bit = lsb),
+// K_C expands a leaf seed into its vector_dim + 1 output words.
+// ------------------------------------------------------------
+namespace {
 
-uint64_t PRG::next_u64() {
-    uint64_t x = state;
-    x ^= x >> 12;
-    x ^= x << 25;
-    x ^= x >> 27;
-    state = x;
-    return x * 0x2545F4914F6CDD1DULL;
+const unsigned char PRG_KEY_L[16] = {0x3f, 0x84, 0xd5, 0xb5, 0xb5, 0x47, 0x09, 0x17,
+                                     0x92, 0x16, 0xd5, 0xd9, 0x89, 0x79, 0xfb, 0x1b};
+const unsigned char PRG_KEY_R[16] = {0xd1, 0x31, 0x0b, 0xa6, 0x98, 0xdf, 0xb5, 0xac,
+                                     0x2f, 0xfd, 0x72, 0xdb, 0xd0, 0x1a, 0xdf, 0xb7};
+const unsigned char PRG_KEY_C[16] = {0xb8, 0xe1, 0xaf, 0xed, 0x6a, 0x26, 0x7e, 0x96,
+                                     0xba, 0x7c, 0x90, 0x45, 0xf1, 0x2c, 0x7f, 0x99};
+
+const Aes128& aes_L() { static const Aes128 a(PRG_KEY_L); return a; }
+const Aes128& aes_R() { static const Aes128 a(PRG_KEY_R); return a; }
+const Aes128& aes_C() { static const Aes128 a(PRG_KEY_C); return a; }
+
+// out[i] = H(in[i]); in and out must not overlap
+void mmo(const Aes128& aes, const Block* in, Block* out, size_t n) {
+    aes.encrypt(reinterpret_cast<const unsigned char*>(in), reinterpret_cast<unsigned char*>(out), n);
+    for (size_t i = 0; i < n; i++) out[i] ^= in[i];
 }
 
-void PRG::fill_u64(std::vector<uint64_t>& out, size_t n) {
-    out.clear();
-    out.reserve(n);
-    for (size_t i = 0; i < n; i++) {
-        out.push_back(next_u64());
+// Nodes per PRG batch
+constexpr size_t NODE_BATCH = 64;
+
+// Leaf seed -> words in Z_{2^64}: word 2j, 2j+1 are the halves of H_C(s ^ j)
+void convert_leaf(Block s, uint32_t words, uint64_t* out) {
+    Block in[NODE_BATCH], blk[NODE_BATCH];
+    size_t blocks = (words + 1) / 2;
+    for (size_t b0 = 0; b0 < blocks; b0 += NODE_BATCH) {
+        size_t n = std::min(NODE_BATCH, blocks - b0);
+        for (size_t j = 0; j < n; j++) in[j] = s ^ (Block)(b0 + j);
+        mmo(aes_C(), in, blk, n);
+        for (size_t j = 0; j < n; j++) {
+            size_t w = 2 * (b0 + j);
+            out[w] = (uint64_t)blk[j];
+            if (w + 1 < words) out[w + 1] = (uint64_t)(blk[j] >> 64);
+        }
     }
 }
 
+void put_u64(std::vector<uint8_t>& buf, uint64_t x) {
+    for (int i = 0; i < 8; i++) buf.push_back((x >> (i * 8)) & 0xFF);
+}
+
+}
+
 
 std::vector<uint8_t> DPFKey::serialize() const {
     std::vector<uint8_t> buf;
-    
-    for (int i = 0; i < 8; i++)
-        buf.push_back((prg_seed >> (i * 8)) & 0xFF);
-    
+    buf.reserve(16 + 1 + 4 + 17 * cw.size() + 8 + 8 * fcw.size() + 8 * leaf_cw.size());
+
+    put_u64(buf, (uint64_t)root_seed);
+    put_u64(buf, (uint64_t)(root_seed >> 64));
+    buf.push_back((uint8_t)(root_t | (party << 1)));
+
     for (int i = 0; i < 4; i++)
         buf.push_back((tree_height >> (i * 8)) & 0xFF);
-    
-    for (int i = 0; i < 8; i++)
-        buf.push_back((index >> (i * 8)) & 0xFF);
-    
-    uint64_t fcw_size = fcw.size();
-    for (int i = 0; i < 8; i++)
-        buf.push_back((fcw_size >> (i * 8)) & 0xFF);
-    
-    for (auto v : fcw) {
-        uint64_t x = (uint64_t)v;
-        for (int i = 0; i < 8; i++)
-            buf.push_back((x >> (i * 8)) & 0xFF);
+
+    for (const LevelCW& c : cw) {
+        put_u64(buf, (uint64_t)c.seed);
+        put_u64(buf, (uint64_t)(c.seed >> 64));
+        buf.push_back((uint8_t)(c.t_left | (c.t_right << 1)));
     }
+
+    put_u64(buf, fcw.size());
+    for (auto v : fcw) put_u64(buf, (uint64_t)v);
+    for (auto v : leaf_cw) put_u64(buf, v);
     return buf;
 }
 
@@ -50,86 +88,850 @@ DPFKey DPFKey::deserialize(const std::vector<uint8_t>& bytes) {
     DPFKey k;
     size_t pos = 0;
 
+    auto need = [&](size_t n) {
+        if (bytes.size() - pos < n) throw std::runtime_error("truncated DPF key");
+    };
     auto read_u64 = [&](uint64_t &out) {
+        need(8);
         out = 0;
         for (int i = 0; i < 8; i++)
             out |= (uint64_t(bytes[pos++]) << (i * 8));
     };
     auto read_u32 = [&](uint32_t &out) {
+        need(4);
         out = 0;
         for (int i = 0; i < 4; i++)
             out |= (uint32_t(bytes[pos++]) << (i * 8));
     };
+    auto read_block = [&](Block &out) {
+        uint64_t lo, hi;
+        read_u64(lo);
+        read_u64(hi);
+        out = ((Block)hi << 64) | lo;
+    };
 
-    read_u64(k.prg_seed);
+    read_block(k.root_seed);
+    need(1);
+    k.root_t = bytes[pos] & 1;
+    k.party = (bytes[pos] >> 1) & 1;
+    pos++;
     read_u32(k.tree_height);
+    if (k.tree_height > 63) throw std::runtime_error("bad DPF key height");
 
-    uint64_t idx_val;
-    read_u64(idx_val);
-    k.index = idx_val;
+    k.cw.resize(k.tree_height);
+    for (auto& c : k.cw) {
+        read_block(c.seed);
+        need(1);
+        c.t_left = bytes[pos] & 1;
+        c.t_right = (bytes[pos] >> 1) & 1;
+        pos++;
+    }
 
     uint64_t fcw_size;
     read_u64(fcw_size);
+    if (fcw_size > (bytes.size() - pos) / 16) throw std::runtime_error("truncated DPF key");
     k.fcw.resize(fcw_size);
+    k.leaf_cw.resize(fcw_size + 1);
 
     for (uint64_t idx = 0; idx < fcw_size; idx++) {
         uint64_t tmp;
         read_u64(tmp);
         k.fcw[idx] = (FieldT)tmp;
     }
+    for (auto& v : k.leaf_cw) read_u64(v);
     return k;
 }
 
 std::pair<DPFKey, DPFKey> Gen_point_zero(
     DomainIndex idx,
     uint32_t tree_height,
-    uint32_t vector_dim,
-    std::mt19937_64& rng)
+    uint32_t vector_dim)
 {
+    if (tree_height > 63 || idx >= domain_size_from_height(tree_height))
+        throw std::invalid_argument("index out of DPF domain");
+
     DPFKey k0, k1;
 
-    
-    k0.prg_seed = rng();
-    k1.prg_seed = k0.prg_seed; 
+    k0.root_seed = csprng().next<Block>();
+    k1.root_seed = csprng().next<Block>();
+    k0.root_t = 0;
+    k1.root_t = 1;
+    k0.party = 0;
+    k1.party = 1;
 
     k0.tree_height = tree_height;
     k1.tree_height = tree_height;
+    k0.cw.resize(tree_height);
+
+    Block s[2] = {k0.root_seed, k1.root_seed};
+    uint8_t t[2] = {0, 1};
+
+    for (uint32_t i = 0; i < tree_height; i++) {
+        Block L[2], R[2];
+        mmo(aes_L(), s, L, 2);
+        mmo(aes_R(), s, R, 2);
+
+        bool bit = (idx >> (tree_height - 1 - i)) & 1;
+        LevelCW& c = k0.cw[i];
+        // The lose-side seeds are made equal; keep-side control bits differ
+        c.seed = bit ? (L[0] ^ L[1]) : (R[0] ^ R[1]);
+        c.t_left = (uint8_t)(((L[0] ^ L[1]) & 1) ^ bit ^ 1);
+        c.t_right = (uint8_t)(((R[0] ^ R[1]) & 1) ^ bit);
+
+        for (int b = 0; b < 2; b++) {
+            Block keep = bit ? R[b] : L[b];
+            uint8_t keep_t = (uint8_t)(keep & 1);
+            if (t[b]) {
+                keep ^= c.seed;
+                keep_t ^= bit ? c.t_right : c.t_left;
+            }
+            s[b] = keep;
+            t[b] = keep_t;
+        }
+    }
+    k1.cw = k0.cw;
 
-    k0.index = idx;
-    k1.index = idx;
+    // Payload (r, 1): r is shared out as FCW_0 + FCW_1, and the trailing 1
+    // gives the servers shares of the target indicator to scale FCW_m by
+    k0.fcw.resize(vector_dim);
+    k1.fcw.resize(vector_dim);
+    std::vector<uint64_t> beta(vector_dim + 1, 1);
+    for (uint32_t d = 0; d < vector_dim; d++) {
+        uint64_t r0 = csprng().next_u64(), r1 = csprng().next_u64();
+        k0.fcw[d] = (FieldT)r0;
+        k1.fcw[d] = (FieldT)r1;
+        beta[d] = r0 + r1;
+    }
 
-    k0.fcw.assign(vector_dim, FieldT(0));
-    k1.fcw.assign(vector_dim, FieldT(0));
+    // Outputs at the target sum to c0 - c1 + (t0 - t1) * leaf_cw, and
+    // t0 - t1 = (-1)^t1, so the correction word carries that sign
+    std::vector<uint64_t> c0(vector_dim + 1), c1(vector_dim + 1);
+    convert_leaf(s[0], vector_dim + 1, c0.data());
+    convert_leaf(s[1], vector_dim + 1, c1.data());
+    uint64_t neg = -(uint64_t)t[1];
+    k0.leaf_cw.resize(vector_dim + 1);
+    for (uint32_t w = 0; w <= vector_dim; w++) {
+        uint64_t v = beta[w] - c0[w] + c1[w];
+        k0.leaf_cw[w] = (v ^ neg) - neg;
+    }
+    k1.leaf_cw = k0.leaf_cw;
 
     return {k0, k1};
 }
 
+std::pair<DPFKey, DPFKey> Gen_point_read(DomainIndex idx, uint32_t tree_height) {
+    auto keys = Gen_point_zero(idx, tree_height, 1);
+    // No exchange for a read: the user sets FCW_m = 1 - r itself
+    FieldT f = (FieldT)(1 - (uint64_t)keys.first.fcw[0] - (uint64_t)keys.second.fcw[0]);
+    keys.first.fcw[0] = f;
+    keys.second.fcw[0] = f;
+    return keys;
+}
+
 
-std::vector<FieldT> EvalFull(const DPFKey& key) {
-    uint64_t domain_size = domain_size_from_height(key.tree_height);
-    uint32_t vector_dim = (uint32_t)key.fcw.size();
+namespace {
 
-    uint64_t total = domain_size * vector_dim;
+void check_key(const DPFKey& key) {
+    if (key.tree_height > 63 || key.cw.size() != key.tree_height ||
+        key.leaf_cw.size() != key.fcw.size() + 1)
+        throw std::invalid_argument("malformed DPF key");
+}
 
-    PRG prg(key.prg_seed);
-    std::vector<uint64_t> raw_u64;
-    prg.fill_u64(raw_u64, total);
+// One node's child in direction bit
+void descend(const LevelCW& c, Block s, uint8_t t, bool bit, Block& s_out, uint8_t& t_out) {
+    Block child;
+    mmo(bit ? aes_R() : aes_L(), &s, &child, 1);
+    Block scw = c.seed & -(Block)t;
+    s_out = child ^ scw;
+    t_out = (uint8_t)((child & 1) ^ ((bit ? c.t_right : c.t_left) & t));
+}
 
-    std::vector<FieldT> out(total);
-    for (uint64_t i = 0; i < total; i++) {
-        out[i] = (FieldT)(raw_u64[i] & 0x7FFFFFFFFFFFFFFFULL); 
+// Expands seeds[0], t[0] (a node at depth `level`) down `levels` levels in
+// place: node j's children go to 2j and 2j+1, so each level is walked from
+// the top down and a batch is read out before its children are written.
+// Only the first `leaves` leaves are needed: nodes whose subtree lies
+// entirely past them are not expanded.
+void expand_subtree(const DPFKey& key, uint32_t level, uint32_t levels, uint64_t leaves,
+                    Block* seeds, uint8_t* t) {
+    Block in[NODE_BATCH], L[NODE_BATCH], R[NODE_BATCH];
+    uint8_t tin[NODE_BATCH];
+    for (uint32_t i = 0; i < levels; i++) {
+        const LevelCW& c = key.cw[level + i];
+        uint32_t below = levels - i;
+        uint64_t width = std::min(1ULL << i, (leaves + (1ULL << below) - 1) >> below);
+        for (uint64_t hi = width; hi > 0;) {
+            uint64_t lo = hi > NODE_BATCH ? hi - NODE_BATCH : 0;
+            size_t n = hi - lo;
+            for (size_t q = 0; q < n; q++) {
+                in[q] = seeds[lo + q];
+                tin[q] = t[lo + q];
+            }
+            mmo(aes_L(), in, L, n);
+            mmo(aes_R(), in, R, n);
+            for (size_t q = 0; q < n; q++) {
+                // Branch-free correction: control bits are random
+                Block scw = c.seed & -(Block)tin[q];
+                uint64_t j = lo + q;
+                seeds[2 * j] = L[q] ^ scw;
+                t[2 * j] = (uint8_t)((L[q] & 1) ^ (c.t_left & tin[q]));
+                seeds[2 * j + 1] = R[q] ^ scw;
+                t[2 * j + 1] = (uint8_t)((R[q] & 1) ^ (c.t_right & tin[q]));
+            }
+            hi = lo;
+        }
     }
+}
 
+// Adds the (sign-adjusted) outputs of n leaves to dst. Leaf x: y = conv(s_x)
+// + t_x * leaf_cw shares (r, 1) at the target, so y[0..d) + FCW_m * y[d]
+// shares M there; neg = all-ones negates the whole sum.
+// Stores of the leaf kernels. The streaming (NT) variants write with
+// non-temporal stores, so the share array goes straight to memory instead of
+// displacing the chunk scratch from cache; a kernel that used them fences
+// before returning, so its stores are ordered before any hand-off.
+template <bool NT>
+inline void store_word(uint64_t* p, uint64_t v) {
+#if defined(__SSE2__)
+    if constexpr (NT) {
+        _mm_stream_si64(reinterpret_cast<long long*>(p), (long long)v);
+        return;
+    }
+#endif
+    *p = v;
+}
 
-    uint64_t target = key.index;
-    if (target < domain_size) {
+template <bool NT>
+inline void stream_fence() {
+#if defined(__SSE2__)
+    if constexpr (NT) _mm_sfence();
+#endif
+}
+
+template <bool NT>
+void accumulate_leaves(const DPFKey& key, const Block* seeds, const uint8_t* t, uint64_t n,
+                       uint64_t neg, uint64_t* y, uint64_t* dst) {
+    uint32_t vector_dim = (uint32_t)key.fcw.size();
+    for (uint64_t x = 0; x < n; x++) {
+        uint64_t* item = dst + x * vector_dim;
+        convert_leaf(seeds[x], vector_dim + 1, y);
+        uint64_t mask = -(uint64_t)t[x];
+        uint64_t e = y[vector_dim] + (key.leaf_cw[vector_dim] & mask);
         for (uint32_t d = 0; d < vector_dim; d++) {
-            uint64_t idx2 = target * vector_dim + d;
-            out[idx2] += key.fcw[d];
+            uint64_t v = y[d] + (key.leaf_cw[d] & mask) + (uint64_t)key.fcw[d] * e;
+            store_word<NT>(item + d, item[d] + ((v ^ neg) - neg));
+        }
+    }
+    stream_fence<NT>();
+}
+
+// Adds the FCW-independent part of n leaves' outputs to dst and writes each
+// leaf's last word to e: with y = conv(s_x) + t_x * leaf_cw, item x gets
+// y[0..d) now and e[x] = y[d] is kept for the FCW_m term, both negated if
+// neg is all-ones
+template <bool NT>
+void prepare_leaves(const DPFKey& key, const Block* seeds, const uint8_t* t, uint64_t n,
+                    uint64_t neg, uint64_t* y, uint64_t* dst, uint64_t* e) {
+    uint32_t vector_dim = (uint32_t)key.fcw.size();
+    for (uint64_t x = 0; x < n; x++) {
+        uint64_t* item = dst + x * vector_dim;
+        convert_leaf(seeds[x], vector_dim + 1, y);
+        uint64_t mask = -(uint64_t)t[x];
+        for (uint32_t d = 0; d < vector_dim; d++) {
+            uint64_t v = y[d] + (key.leaf_cw[d] & mask);
+            store_word<NT>(item + d, item[d] + ((v ^ neg) - neg));
+        }
+        uint64_t last = y[vector_dim] + (key.leaf_cw[vector_dim] & mask);
+        store_word<NT>(e + x, (last ^ neg) - neg);
+    }
+    stream_fence<NT>();
+}
+
+// accumulate_leaves specialized on vector_dim D: the PRG blocks of several
+// leaves go through one AES pipeline call and the d-loop is unrolled. The
+// output is identical to the generic kernel.
+template <uint32_t D, bool NT>
+void accumulate_leaves_fixed(const DPFKey& key, const Block* seeds, const uint8_t* t, uint64_t n,
+                             uint64_t neg, uint64_t*, uint64_t* dst) {
+    constexpr uint32_t B = (D + 2) / 2;     // PRG blocks per leaf, ceil((D + 1) / 2)
+    constexpr uint64_t LEAVES = NODE_BATCH / B > 4 ? NODE_BATCH / B : 4;
+    uint64_t cw[D + 1], f[D];
+    std::copy(key.leaf_cw.begin(), key.leaf_cw.end(), cw);
+    for (uint32_t d = 0; d < D; d++) f[d] = (uint64_t)key.fcw[d];
+
+    Block in[LEAVES * B], blk[LEAVES * B];
+    for (uint64_t x0 = 0; x0 < n; x0 += LEAVES) {
+        uint64_t m = std::min(LEAVES, n - x0);
+        for (uint64_t q = 0; q < m; q++) {
+            for (uint32_t j = 0; j < B; j++) in[q * B + j] = seeds[x0 + q] ^ (Block)j;
+        }
+        mmo(aes_C(), in, blk, m * B);
+        for (uint64_t q = 0; q < m; q++) {
+            uint64_t y[2 * B];
+            std::memcpy(y, blk + q * B, sizeof(y));
+            uint64_t mask = -(uint64_t)t[x0 + q];
+            uint64_t e = y[D] + (cw[D] & mask);
+            uint64_t* item = dst + (x0 + q) * D;
+#pragma GCC unroll 16
+            for (uint32_t d = 0; d < D; d++) {
+                uint64_t v = y[d] + (cw[d] & mask) + f[d] * e;
+                store_word<NT>(item + d, item[d] + ((v ^ neg) - neg));
+            }
+        }
+    }
+    stream_fence<NT>();
+}
+
+// out[x] += FCW_m * e[x] over prepared items (e carries the sign already)
+template <bool NT>
+void finish_items(const uint64_t* e, const FieldT* fcw, uint32_t vector_dim, uint64_t items, uint64_t* out) {
+    for (uint64_t x = 0; x < items; x++, out += vector_dim) {
+        for (uint32_t d = 0; d < vector_dim; d++)
+            store_word<NT>(out + d, out[d] + (uint64_t)fcw[d] * e[x]);
+    }
+    stream_fence<NT>();
+}
+
+template <uint32_t D, bool NT>
+void finish_items_fixed(const uint64_t* e, const FieldT* fcw, uint32_t, uint64_t items, uint64_t* out) {
+    uint64_t f[D];
+    for (uint32_t d = 0; d < D; d++) f[d] = (uint64_t)fcw[d];
+    for (uint64_t x = 0; x < items; x++, out += D) {
+#pragma GCC unroll 16
+        for (uint32_t d = 0; d < D; d++) store_word<NT>(out + d, out[d] + f[d] * e[x]);
+    }
+    stream_fence<NT>();
+}
+
+// acc[0..item_dim) += sum over n leaves of sel_x * V[x], where sel_x is the
+// scalar output of a read key (negated if neg is all-ones). The selector of
+// NODE_BATCH leaves at a time stays in registers/L1 and is never stored.
+void dot_leaves(const DPFKey& key, const Block* seeds, const uint8_t* t, uint64_t n, uint64_t neg,
+                const FieldT* V, uint32_t item_dim, uint64_t* acc) {
+    uint64_t cw0 = key.leaf_cw[0], cw1 = key.leaf_cw[1], f = (uint64_t)key.fcw[0];
+    const uint64_t* v = reinterpret_cast<const uint64_t*>(V);
+    Block blk[NODE_BATCH];
+    uint64_t sel[NODE_BATCH];
+    for (uint64_t x0 = 0; x0 < n; x0 += NODE_BATCH) {
+        uint64_t m = std::min<uint64_t>(NODE_BATCH, n - x0);
+        mmo(aes_C(), seeds + x0, blk, m);
+        for (uint64_t q = 0; q < m; q++) {
+            uint64_t mask = -(uint64_t)t[x0 + q];
+            uint64_t y = (uint64_t)blk[q] + (cw0 & mask) + f * ((uint64_t)(blk[q] >> 64) + (cw1 & mask));
+            sel[q] = (y ^ neg) - neg;
+        }
+        const uint64_t* row = v + x0 * item_dim;
+        for (uint64_t q = 0; q < m; q++, row += item_dim) {
+            for (uint32_t d = 0; d < item_dim; d++) acc[d] += sel[q] * row[d];
+        }
+    }
+}
+
+using LeafKernel = void (*)(const DPFKey&, const Block*, const uint8_t*, uint64_t, uint64_t, uint64_t*, uint64_t*);
+using FinishKernel = void (*)(const uint64_t*, const FieldT*, uint32_t, uint64_t, uint64_t*);
+
+// Dimensions with compile-time kernels; any other vector_dim takes the
+// generic ones. Index 1 of each pair is the streaming-store variant.
+struct DimKernels {
+    uint32_t dim;
+    LeafKernel leaves[2];
+    FinishKernel finish[2];
+};
+
+template <uint32_t D>
+constexpr DimKernels dim_entry() {
+    return {D, {accumulate_leaves_fixed<D, false>, accumulate_leaves_fixed<D, true>},
+            {finish_items_fixed<D, false>, finish_items_fixed<D, true>}};
+}
+
+constexpr DimKernels DIM_KERNELS[] = {
+    dim_entry<2>(), dim_entry<4>(), dim_entry<8>(), dim_entry<16>(), dim_entry<32>(), dim_entry<64>(),
+};
+
+std::atomic<bool> g_generic_kernels{false};
+std::atomic<bool> g_streaming_stores{false};
+
+bool streaming_stores() {
+    return g_streaming_stores.load(std::memory_order_relaxed);
+}
+
+const DimKernels* dim_kernels(uint32_t vector_dim) {
+    if (g_generic_kernels.load(std::memory_order_relaxed)) return nullptr;
+    for (const DimKernels& k : DIM_KERNELS) {
+        if (k.dim == vector_dim) return &k;
+    }
+    return nullptr;
+}
+
+LeafKernel leaf_kernel(uint32_t vector_dim, bool streaming) {
+    const DimKernels* k = dim_kernels(vector_dim);
+    if (k) return k->leaves[streaming];
+    return streaming ? accumulate_leaves<true> : accumulate_leaves<false>;
+}
+
+FinishKernel finish_kernel(uint32_t vector_dim, bool streaming) {
+    const DimKernels* k = dim_kernels(vector_dim);
+    if (k) return k->finish[streaming];
+    return streaming ? finish_items<true> : finish_items<false>;
+}
+
+}
+
+void use_generic_kernels(bool on) {
+    g_generic_kernels.store(on, std::memory_order_relaxed);
+}
+
+void use_streaming_stores(bool on) {
+    g_streaming_stores.store(on, std::memory_order_relaxed);
+}
+
+EvalFullStream::EvalFullStream(const DPFKey& key, uint32_t chunk_log, uint64_t num_items)
+    : key_(key)
+{
+    check_key(key);
+    num_items_ = std::min(num_items, domain_size_from_height(key.tree_height));
+    chunk_log_ = std::min(key.tree_height, chunk_log);
+    top_ = key.tree_height - chunk_log_;
+    path_seed_.resize(top_ + 1);
+    path_t_.resize(top_ + 1);
+    path_seed_[0] = key.root_seed;
+    path_t_[0] = key.root_t;
+    seeds_.resize(chunk_items());
+    t_.resize(chunk_items());
+    y_.resize(key.fcw.size() + 1);
+}
+
+bool EvalFullStream::expand_next() {
+    if ((next_ >> top_) || (next_ << chunk_log_) >= num_items_) return false;
+    uint64_t r = next_++;
+    items_ = std::min(chunk_items(), num_items_ - (r << chunk_log_));
+
+    // Consecutive chunks share the root path down to their highest differing
+    // bit, so only the levels below it are recomputed
+    uint32_t from = !path_valid_ ? 0 : top_ - 1 - (63 - __builtin_clzll(r ^ (r - 1)));
+    path_valid_ = true;
+    for (uint32_t i = from; i < top_; i++) {
+        descend(key_.cw[i], path_seed_[i], path_t_[i], (r >> (top_ - 1 - i)) & 1,
+                path_seed_[i + 1], path_t_[i + 1]);
+    }
+    seeds_[0] = path_seed_[top_];
+    t_[0] = path_t_[top_];
+    expand_subtree(key_, top_, chunk_log_, items_, seeds_.data(), t_.data());
+    return true;
+}
+
+void EvalFullStream::add_leaves(uint64_t neg, FieldT* dst, bool streaming) {
+    leaf_kernel((uint32_t)key_.fcw.size(), streaming)(key_, seeds_.data(), t_.data(), items_, neg, y_.data(),
+                                           reinterpret_cast<uint64_t*>(dst));
+}
+
+bool EvalFullStream::next(EvalChunk& chunk) {
+    if (!expand_next()) return false;
+    buf_.assign(items_ * key_.fcw.size(), 0);
+    add_leaves(-(uint64_t)key_.party, buf_.data());
+    chunk.offset = (next_ - 1) << chunk_log_;
+    chunk.items = items_;
+    chunk.values = buf_;
+    return true;
+}
+
+namespace {
+
+// Items covered by a share array: V_b must hold N * vector_dim entries with
+// 0 < N <= 2^tree_height
+uint64_t items_in(const DPFKey& key, std::span<const FieldT> V_b) {
+    uint64_t vector_dim = key.fcw.size();
+    uint64_t n = vector_dim == 0 ? 0 : V_b.size() / vector_dim;
+    if (n == 0 || n * vector_dim != V_b.size() || n > domain_size_from_height(key.tree_height))
+        throw std::invalid_argument("share array does not match the DPF domain");
+    return n;
+}
+
+}
+
+void EvalFullAccumulate(const DPFKey& key, std::span<FieldT> V_b, int sign, uint32_t chunk_log) {
+    check_key(key);
+    EvalFullStream stream(key, chunk_log, items_in(key, V_b));
+    uint32_t vector_dim = (uint32_t)key.fcw.size();
+
+    // Leaves are added straight into V_b rather than through the chunk buffer
+    uint64_t neg = -(uint64_t)(key.party ^ (sign < 0));
+    while (stream.expand_next()) {
+        uint64_t offset = (stream.next_ - 1) << stream.chunk_log_;
+        stream.add_leaves(neg, V_b.data() + offset * vector_dim, streaming_stores());
+    }
+}
+
+namespace {
+
+// Runs contiguous ranges of chunks as pool tasks. make_task(k) returns task
+// k's producer, called as produce(c, dst) for its chunks in order to add
+// chunk c's contribution (chunk_words words) to dst. No two tasks write the
+// same cache line of V_b: a task's last chunk goes to a local buffer, and
+// the words sharing a line with the next task are added after the join.
+template <class MakeTask>
+void run_chunk_tasks(WorkStealingPool& pool, size_t tasks, uint64_t chunks, uint64_t chunk_words,
+                     std::span<FieldT> V_b, MakeTask make_task) {
+    struct alignas(64) Tail {
+        uint64_t at = 0, n = 0;
+        FieldT w[8];
+    };
+    std::vector<Tail> tails(tasks);
+
+    pool.run(tasks, [&](size_t k) {
+        uint64_t lo = k * chunks / tasks, hi = (k + 1) * chunks / tasks;
+        auto produce = make_task(k);
+        for (uint64_t c = lo; c < hi; c++) {
+            FieldT* dst = V_b.data() + c * chunk_words;
+            if (c + 1 < hi || k + 1 == tasks) {
+                produce(c, dst);
+                continue;
+            }
+            std::vector<FieldT> last(chunk_words, 0);
+            produce(c, last.data());
+            uint64_t cut = chunk_words - ((uintptr_t)(dst + chunk_words) % 64) / sizeof(FieldT);
+            for (uint64_t i = 0; i < cut; i++) dst[i] = (FieldT)((uint64_t)dst[i] + (uint64_t)last[i]);
+            tails[k].at = c * chunk_words + cut;
+            tails[k].n = chunk_words - cut;
+            std::copy(last.begin() + cut, last.end(), tails[k].w);
+        }
+    });
+    for (const Tail& tl : tails) {
+        for (uint64_t i = 0; i < tl.n; i++)
+            V_b[tl.at + i] = (FieldT)((uint64_t)V_b[tl.at + i] + (uint64_t)tl.w[i]);
+    }
+}
+
+}
+
+void EvalFullAccumulate(const DPFKey& key, std::span<FieldT> V_b, int sign,
+                        WorkStealingPool& pool, uint32_t chunk_log) {
+    check_key(key);
+    uint64_t items = items_in(key, V_b);
+    uint32_t vector_dim = (uint32_t)key.fcw.size();
+    chunk_log = std::min(key.tree_height, chunk_log);
+    // Chunks past the last item are never visited; only the last one is partial
+    uint64_t chunks = ((items - 1) >> chunk_log) + 1;
+    uint64_t chunk_words = (1ULL << chunk_log) * vector_dim;
+    size_t tasks = (size_t)std::min<uint64_t>(chunks, 8 * (uint64_t)pool.size());
+    // A chunk must cover a whole cache line for the tail hand-off
+    if (pool.size() == 1 || tasks == 1 || chunk_words < 8) {
+        EvalFullAccumulate(key, V_b, sign, chunk_log);
+        return;
+    }
+
+    uint64_t neg = -(uint64_t)(key.party ^ (sign < 0));
+    bool streaming = streaming_stores();
+    run_chunk_tasks(pool, tasks, chunks, chunk_words, V_b, [&](size_t) {
+        auto stream = std::make_shared<EvalFullStream>(key, chunk_log, items);
+        return [stream, neg, streaming](uint64_t c, FieldT* dst) {
+            if (stream->next_ != c) stream->seek_chunk(c);
+            stream->expand_next();
+            stream->add_leaves(neg, dst, streaming);
+        };
+    });
+}
+
+namespace {
+
+// Walks several keys through the same chunk sequence with one shared subtree
+// scratch; per key only the root-to-chunk path is kept. Chunk c of every key
+// is summed into an accumulator that is added to the destination once.
+class BatchWalker {
+public:
+    BatchWalker(std::span<const DPFKey> keys, int sign, uint32_t chunk_log, uint64_t num_items)
+        : keys_(keys), num_items_(num_items)
+    {
+        const DPFKey& k0 = keys.front();
+        vector_dim_ = (uint32_t)k0.fcw.size();
+        chunk_log_ = std::min(k0.tree_height, chunk_log);
+        top_ = k0.tree_height - chunk_log_;
+        path_seed_.resize(keys.size() * (top_ + 1));
+        path_t_.resize(keys.size() * (top_ + 1));
+        for (size_t k = 0; k < keys.size(); k++) {
+            path_seed_[k * (top_ + 1)] = keys[k].root_seed;
+            path_t_[k * (top_ + 1)] = keys[k].root_t;
+            negs_.push_back(-(uint64_t)(keys[k].party ^ (sign < 0)));
+        }
+        seeds_.resize(1ULL << chunk_log_);
+        t_.resize(1ULL << chunk_log_);
+        y_.resize(vector_dim_ + 1);
+        acc_.resize((1ULL << chunk_log_) * vector_dim_);
+        // The accumulator stays in cache; only its sum into V_b may stream
+        kernel_ = leaf_kernel(vector_dim_, false);
+        streaming_ = streaming_stores();
+    }
+
+    uint64_t chunk_words() const { return acc_.size(); }
+
+    void add_chunk(uint64_t c, FieldT* dst) {
+        // Levels above the highest bit where c differs from the last chunk
+        // are still valid in every key's path
+        uint32_t from = 0;
+        if (valid_) from = prev_ == c ? top_ : top_ - 1 - (63 - __builtin_clzll(prev_ ^ c));
+        valid_ = true;
+        prev_ = c;
+
+        uint64_t items = std::min<uint64_t>(1ULL << chunk_log_, num_items_ - (c << chunk_log_));
+        std::fill(acc_.begin(), acc_.end(), 0);
+        for (size_t k = 0; k < keys_.size(); k++) {
+            const DPFKey& key = keys_[k];
+            Block* ps = path_seed_.data() + k * (top_ + 1);
+            uint8_t* pt = path_t_.data() + k * (top_ + 1);
+            for (uint32_t i = from; i < top_; i++)
+                descend(key.cw[i], ps[i], pt[i], (c >> (top_ - 1 - i)) & 1, ps[i + 1], pt[i + 1]);
+            seeds_[0] = ps[top_];
+            t_[0] = pt[top_];
+            expand_subtree(key, top_, chunk_log_, items, seeds_.data(), t_.data());
+            kernel_(key, seeds_.data(), t_.data(), items, negs_[k], y_.data(), acc_.data());
+        }
+        uint64_t* out = reinterpret_cast<uint64_t*>(dst);
+        if (streaming_) {
+            for (uint64_t i = 0; i < items * vector_dim_; i++) store_word<true>(out + i, out[i] + acc_[i]);
+            stream_fence<true>();
+        } else {
+            for (uint64_t i = 0; i < items * vector_dim_; i++) out[i] += acc_[i];
+        }
+    }
+
+private:
+    std::span<const DPFKey> keys_;
+    LeafKernel kernel_;
+    bool streaming_;
+    uint64_t num_items_;
+    uint32_t vector_dim_, chunk_log_, top_;
+    std::vector<Block> path_seed_;
+    std::vector<uint8_t> path_t_;
+    std::vector<uint64_t> negs_;
+    std::vector<Block> seeds_;
+    std::vector<uint8_t> t_;
+    std::vector<uint64_t> y_;
+    std::vector<uint64_t> acc_;
+    bool valid_ = false;
+    uint64_t prev_ = 0;
+};
+
+// Validates a batch and returns the item count of V_b
+uint64_t check_batch(std::span<const DPFKey> keys, std::span<FieldT> V_b) {
+    if (keys.empty()) throw std::invalid_argument("empty DPF key batch");
+    for (const DPFKey& k : keys) {
+        check_key(k);
+        if (k.tree_height != keys[0].tree_height || k.fcw.size() != keys[0].fcw.size())
+            throw std::invalid_argument("DPF keys in a batch must share height and vector_dim");
+    }
+    return items_in(keys[0], V_b);
+}
+
+}
+
+void EvalFullAccumulateBatch(std::span<const DPFKey> keys, std::span<FieldT> V_b, int sign,
+                             uint32_t chunk_log) {
+    uint64_t items = check_batch(keys, V_b);
+    BatchWalker walker(keys, sign, chunk_log, items);
+    uint64_t chunks = (V_b.size() + walker.chunk_words() - 1) / walker.chunk_words();
+    for (uint64_t c = 0; c < chunks; c++) walker.add_chunk(c, V_b.data() + c * walker.chunk_words());
+}
+
+void EvalFullAccumulateBatch(std::span<const DPFKey> keys, std::span<FieldT> V_b, int sign,
+                             WorkStealingPool& pool, uint32_t chunk_log) {
+    uint64_t items = check_batch(keys, V_b);
+    chunk_log = std::min(keys[0].tree_height, chunk_log);
+    uint64_t chunks = ((items - 1) >> chunk_log) + 1;
+    uint64_t chunk_words = (1ULL << chunk_log) * keys[0].fcw.size();
+    size_t tasks = (size_t)std::min<uint64_t>(chunks, 8 * (uint64_t)pool.size());
+    if (pool.size() == 1 || tasks == 1 || chunk_words < 8) {
+        EvalFullAccumulateBatch(keys, V_b, sign, chunk_log);
+        return;
+    }
+    run_chunk_tasks(pool, tasks, chunks, chunk_words, V_b, [&](size_t) {
+        auto walker = std::make_shared<BatchWalker>(keys, sign, chunk_log, items);
+        return [walker](uint64_t c, FieldT* dst) { walker->add_chunk(c, dst); };
+    });
+}
+
+std::vector<FieldT> EvalFull(const DPFKey& key, uint64_t num_items) {
+    check_key(key);
+    num_items = std::min(num_items, domain_size_from_height(key.tree_height));
+    std::vector<FieldT> out(num_items * key.fcw.size(), 0);
+    EvalFullAccumulate(key, out, +1);
+    return out;
+}
+
+std::vector<FieldT> EvalFull(const DPFKey& key, WorkStealingPool& pool, uint64_t num_items) {
+    check_key(key);
+    num_items = std::min(num_items, domain_size_from_height(key.tree_height));
+    std::vector<FieldT> out(num_items * key.fcw.size(), 0);
+    EvalFullAccumulate(key, out, +1, pool);
+    return out;
+}
+
+PreparedEval PrepareEval(const DPFKey& key, std::span<FieldT> V_b, int sign) {
+    check_key(key);
+    EvalFullStream stream(key, DEFAULT_CHUNK_LOG, items_in(key, V_b));
+    uint32_t vector_dim = (uint32_t)key.fcw.size();
+    PreparedEval prep{stream.num_items(), vector_dim, decltype(PreparedEval::e)(stream.num_items())};
+
+    uint64_t neg = -(uint64_t)(key.party ^ (sign < 0));
+    auto prepare = streaming_stores() ? prepare_leaves<true> : prepare_leaves<false>;
+    while (stream.expand_next()) {
+        uint64_t offset = (stream.next_ - 1) << stream.chunk_log_;
+        prepare(key, stream.seeds_.data(), stream.t_.data(), stream.items_, neg, stream.y_.data(),
+                reinterpret_cast<uint64_t*>(V_b.data()) + offset * vector_dim, prep.e.data() + offset);
+    }
+    return prep;
+}
+
+PreparedEval PrepareEval(const DPFKey& key, std::span<FieldT> V_b, int sign, WorkStealingPool& pool) {
+    check_key(key);
+    uint64_t items = items_in(key, V_b);
+    uint32_t vector_dim = (uint32_t)key.fcw.size();
+    uint32_t chunk_log = std::min(key.tree_height, DEFAULT_CHUNK_LOG);
+    uint64_t chunks = ((items - 1) >> chunk_log) + 1;
+    uint64_t chunk_words = (1ULL << chunk_log) * vector_dim;
+    size_t tasks = (size_t)std::min<uint64_t>(chunks, 8 * (uint64_t)pool.size());
+    if (pool.size() == 1 || tasks == 1 || chunk_words < 8) return PrepareEval(key, V_b, sign);
+
+    PreparedEval prep{items, vector_dim, decltype(PreparedEval::e)(items)};
+    uint64_t neg = -(uint64_t)(key.party ^ (sign < 0));
+    auto prepare = streaming_stores() ? prepare_leaves<true> : prepare_leaves<false>;
+    // e is line-aligned and more than one chunk means chunk_log = 12, so each
+    // task's range of e starts on its own cache line and needs no hand-off
+    uint64_t* e = prep.e.data();
+    run_chunk_tasks(pool, tasks, chunks, chunk_words, V_b, [&](size_t) {
+        auto stream = std::make_shared<EvalFullStream>(key, chunk_log, items);
+        return [stream, neg, prepare, e](uint64_t c, FieldT* dst) {
+            if (stream->next_ != c) stream->seek_chunk(c);
+            stream->expand_next();
+            prepare(stream->key_, stream->seeds_.data(), stream->t_.data(), stream->items_, neg,
+                    stream->y_.data(), reinterpret_cast<uint64_t*>(dst), e + (c << stream->chunk_log_));
+        };
+    });
+    return prep;
+}
+
+namespace {
+
+void check_prepared(const PreparedEval& prep, std::span<const FieldT> FCW_m, std::span<FieldT> V_b) {
+    if (FCW_m.size() != prep.vector_dim || V_b.size() != prep.num_items * prep.vector_dim)
+        throw std::invalid_argument("FCW_m or share array does not match the prepared key");
+}
+
+}
+
+void FinishEvalAccumulate(const PreparedEval& prep, std::span<const FieldT> FCW_m, std::span<FieldT> V_b) {
+    check_prepared(prep, FCW_m, V_b);
+    finish_kernel(prep.vector_dim, streaming_stores())(prep.e.data(), FCW_m.data(), prep.vector_dim,
+                                                       prep.num_items, reinterpret_cast<uint64_t*>(V_b.data()));
+}
+
+void FinishEvalAccumulate(const PreparedEval& prep, std::span<const FieldT> FCW_m, std::span<FieldT> V_b,
+                          WorkStealingPool& pool) {
+    check_prepared(prep, FCW_m, V_b);
+    uint64_t chunk_items = 1ULL << DEFAULT_CHUNK_LOG;
+    uint64_t chunks = (prep.num_items + chunk_items - 1) / chunk_items;
+    uint64_t chunk_words = chunk_items * prep.vector_dim;
+    size_t tasks = (size_t)std::min<uint64_t>(chunks, 8 * (uint64_t)pool.size());
+    if (pool.size() == 1 || tasks == 1) {
+        FinishEvalAccumulate(prep, FCW_m, V_b);
+        return;
+    }
+
+    FinishKernel finish = finish_kernel(prep.vector_dim, streaming_stores());
+    run_chunk_tasks(pool, tasks, chunks, chunk_words, V_b, [&](size_t) {
+        return [&prep, &FCW_m, finish, chunk_items](uint64_t c, FieldT* dst) {
+            uint64_t lo = c * chunk_items, n = std::min(chunk_items, prep.num_items - lo);
+            finish(prep.e.data() + lo, FCW_m.data(), prep.vector_dim, n, reinterpret_cast<uint64_t*>(dst));
+        };
+    });
+}
+
+namespace {
+
+// A read key over a replicated item table of V.size() / item_dim items
+uint64_t check_read(const DPFKey& key, std::span<const FieldT> V, uint32_t item_dim) {
+    check_key(key);
+    uint64_t n = item_dim == 0 ? 0 : V.size() / item_dim;
+    if (key.fcw.size() != 1 || n == 0 || n * item_dim != V.size() ||
+        n > domain_size_from_height(key.tree_height))
+        throw std::invalid_argument("read key does not match the item table");
+    return n;
+}
+
+}
+
+std::vector<FieldT> EvalInnerProduct(const DPFKey& key, std::span<const FieldT> V, uint32_t item_dim,
+                                     uint32_t chunk_log) {
+    uint64_t items = check_read(key, V, item_dim);
+    EvalFullStream stream(key, chunk_log, items);
+    std::vector<uint64_t> acc(item_dim, 0);
+    uint64_t neg = -(uint64_t)key.party;
+    while (stream.expand_next()) {
+        uint64_t offset = (stream.next_ - 1) << stream.chunk_log_;
+        dot_leaves(key, stream.seeds_.data(), stream.t_.data(), stream.items_, neg,
+                   V.data() + offset * item_dim, item_dim, acc.data());
+    }
+    return std::vector<FieldT>(acc.begin(), acc.end());
+}
+
+std::vector<FieldT> EvalInnerProduct(const DPFKey& key, std::span<const FieldT> V, uint32_t item_dim,
+                                     WorkStealingPool& pool, uint32_t chunk_log) {
+    uint64_t items = check_read(key, V, item_dim);
+    chunk_log = std::min(key.tree_height, chunk_log);
+    uint64_t chunks = ((items - 1) >> chunk_log) + 1;
+    size_t tasks = (size_t)std::min<uint64_t>(chunks, 8 * (uint64_t)pool.size());
+    if (pool.size() == 1 || tasks == 1) return EvalInnerProduct(key, V, item_dim, chunk_log);
+
+    // V is only read, so tasks need no hand-off: each sums its chunk range
+    // into its own line-aligned partial, and the partials are added at the end
+    struct alignas(64) Partial {
+        std::vector<uint64_t> acc;
+    };
+    std::vector<Partial> partials(tasks);
+    uint64_t neg = -(uint64_t)key.party;
+    pool.run(tasks, [&](size_t k) {
+        uint64_t lo = k * chunks / tasks, hi = (k + 1) * chunks / tasks;
+        EvalFullStream stream(key, chunk_log, items);
+        stream.seek_chunk(lo);
+        std::vector<uint64_t> acc(item_dim, 0);
+        for (uint64_t c = lo; c < hi && stream.expand_next(); c++) {
+            dot_leaves(key, stream.seeds_.data(), stream.t_.data(), stream.items_, neg,
+                       V.data() + (c << chunk_log) * item_dim, item_dim, acc.data());
         }
+        partials[k].acc = std::move(acc);
+    });
+    std::vector<FieldT> out(item_dim, 0);
+    for (const Partial& p : partials) {
+        for (uint32_t d = 0; d < item_dim; d++) out[d] = (FieldT)((uint64_t)out[d] + p.acc[d]);
     }
+    return out;
+}
 
+std::vector<DPFKey> SplitKey(const DPFKey& key, uint32_t levels) {
+    check_key(key);
+    if (levels > key.tree_height) throw std::invalid_argument("split deeper than the DPF tree");
+    std::vector<Block> s = {key.root_seed};
+    std::vector<uint8_t> t = {key.root_t};
+    for (uint32_t i = 0; i < levels; i++) {
+        std::vector<Block> s_next(2 * s.size());
+        std::vector<uint8_t> t_next(2 * s.size());
+        for (size_t p = 0; p < s.size(); p++) {
+            for (int bit = 0; bit < 2; bit++)
+                descend(key.cw[i], s[p], t[p], bit, s_next[2 * p + bit], t_next[2 * p + bit]);
+        }
+        s.swap(s_next);
+        t.swap(t_next);
+    }
+
+    std::vector<DPFKey> out(s.size());
+    for (size_t p = 0; p < s.size(); p++) {
+        out[p].root_seed = s[p];
+        out[p].root_t = t[p];
+        out[p].party = key.party;
+        out[p].tree_height = key.tree_height - levels;
+        out[p].cw.assign(key.cw.begin() + levels, key.cw.end());
+        out[p].leaf_cw = key.leaf_cw;
+        out[p].fcw = key.fcw;
+    }
     return out;
 }
 
-} 
+}
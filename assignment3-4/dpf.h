@@ -7,49 +7,239 @@
 #include <random>
 #include <string>
 #include <cassert>
+#include <span>
+#include <new>
+
+class WorkStealingPool;
 
 namespace cs670 {
 
 using FieldT = int64_t;
-static constexpr FieldT SCALE = 1000000LL; 
+static constexpr FieldT SCALE = 1000000LL;
 
 using DomainIndex = uint64_t;
 
+// One 128-bit (lambda) seed
+using Block = unsigned __int128;
+
+// Correction word of one tree level: seed correction plus the corrections of
+// the left and right control bits
+struct LevelCW {
+    Block seed;
+    uint8_t t_left;
+    uint8_t t_right;
+};
+
+// Seed/correction-word tree DPF key over 2^tree_height items with
+// vector_dim-word payloads in Z_{2^64}. Serialized size is 16 + 1 + 4
+// + 17 * tree_height + 8 + 8 * vector_dim + 8 * (vector_dim + 1) bytes.
+//
+// The tree carries the payload (r, 1) for a random r known only to the user:
+// leaf_cw is its sign-corrected final correction word, so party b's leaf
+// output (-1)^b * (conv(s_x) + t_x * leaf_cw) is an additive share of
+// (r, 1) at the target and of zero elsewhere. fcw holds this server's
+// additive share FCW_b of r; the servers exchange M_b - FCW_b and both set
+// fcw = FCW_m = M - r before EvalFull, which then returns shares of
+// r + FCW_m = M at the target item.
 struct DPFKey {
-    uint64_t prg_seed;           
-    uint32_t tree_height;       
-    DomainIndex index;            
-    std::vector<FieldT> fcw;    
+    Block root_seed;
+    uint8_t root_t;
+    uint8_t party;              // 0 or 1: sign of this key's leaf outputs
+    uint32_t tree_height;
+    std::vector<LevelCW> cw;    // tree_height levels, root first
+    std::vector<uint64_t> leaf_cw;  // vector_dim + 1 words, same in both keys
+    std::vector<FieldT> fcw;
     std::vector<uint8_t> serialize() const;
     static DPFKey deserialize(const std::vector<uint8_t>& bytes);
 };
 
+// Key seeds come from the calling thread's CSPRNG (csprng.hpp)
+std::pair<DPFKey, DPFKey> Gen_point_zero(DomainIndex idx, uint32_t tree_height, uint32_t vector_dim);
+
+// Read keys for a private fetch of item idx from a replicated table
+// (EvalInnerProduct): vector_dim 1, fcw already set so the two keys' outputs
+// sum to 1 at idx and to 0 elsewhere
+std::pair<DPFKey, DPFKey> Gen_point_read(DomainIndex idx, uint32_t tree_height);
+
+
+// Domain bound meaning "every leaf": num_items arguments are clamped to
+// 2^tree_height, and subtrees lying entirely past num_items are never expanded,
+// so N items cost O(N) for any N, not O(2^ceil(log N)).
+inline constexpr uint64_t ALL_ITEMS = ~0ULL;
+
+// Full-domain evaluation of the first num_items items: item x occupies
+// out[x*vector_dim .. (x+1)*vector_dim). The output is already an additive
+// share: once both keys carry FCW_m, EvalFull(k0) + EvalFull(k1) is M at the
+// target item and zero everywhere else (mod 2^64), so it can be added to V_b
+// directly.
+std::vector<FieldT> EvalFull(const DPFKey& key, uint64_t num_items = ALL_ITEMS);
 
-class PRG {
+struct PreparedEval;
+
+// Default leaves per streamed chunk: 2^12 seeds plus control bits fit in L2
+inline constexpr uint32_t DEFAULT_CHUNK_LOG = 12;
+
+// One chunk of EvalFull output: items [offset, offset + items), item-major
+struct EvalChunk {
+    uint64_t offset;
+    uint64_t items;
+    std::span<const FieldT> values;     // items * vector_dim entries
+};
+
+// Streams EvalFull(key, num_items) in chunks of 2^chunk_log items (clamped to
+// the domain; the last chunk may be shorter), expanding one subtree per
+// chunk, so memory is
+// O(2^chunk_log * vector_dim + tree_height) for any domain size. Chunk
+// values are overwritten by the following next(); key must outlive the
+// stream.
+class EvalFullStream {
 public:
-    explicit PRG(uint64_t seed) : state(seed ? seed : 0xdeadbeefcafebabeULL) {}
-    uint64_t next_u64();
-    void fill_u64(std::vector<uint64_t>& out, size_t n);
+    explicit EvalFullStream(const DPFKey& key, uint32_t chunk_log = DEFAULT_CHUNK_LOG,
+                            uint64_t num_items = ALL_ITEMS);
+
+    // Fills chunk with the next piece of output; false once the domain is done
+    bool next(EvalChunk& chunk);
+
+    uint64_t chunk_items() const { return 1ULL << chunk_log_; }
+    uint64_t num_items() const { return num_items_; }
+
 private:
-    uint64_t state;
+    friend void EvalFullAccumulate(const DPFKey&, std::span<FieldT>, int, uint32_t);
+    friend void EvalFullAccumulate(const DPFKey&, std::span<FieldT>, int, WorkStealingPool&, uint32_t);
+    friend PreparedEval PrepareEval(const DPFKey&, std::span<FieldT>, int);
+    friend PreparedEval PrepareEval(const DPFKey&, std::span<FieldT>, int, WorkStealingPool&);
+    friend std::vector<FieldT> EvalInnerProduct(const DPFKey&, std::span<const FieldT>, uint32_t, uint32_t);
+    friend std::vector<FieldT> EvalInnerProduct(const DPFKey&, std::span<const FieldT>, uint32_t,
+                                                WorkStealingPool&, uint32_t);
+
+    // Expands the next subtree's leaves into seeds_/t_
+    bool expand_next();
+
+    // Makes chunk c the next one expanded
+    void seek_chunk(uint64_t c) { next_ = c; path_valid_ = false; }
+
+    // Adds the expanded chunk's outputs, negated if neg is all-ones, to dst
+    // (with non-temporal stores if streaming)
+    void add_leaves(uint64_t neg, FieldT* dst, bool streaming = false);
+
+    const DPFKey& key_;
+    uint64_t num_items_;
+    uint64_t items_ = 0;        // items in the chunk last expanded
+    uint32_t chunk_log_;
+    uint32_t top_;              // depth of the chunk subtree roots
+    uint64_t next_ = 0;         // next chunk index
+    bool path_valid_ = false;   // path_* holds chunk next_ - 1's root path
+    std::vector<Block> path_seed_;
+    std::vector<uint8_t> path_t_;
+    std::vector<Block> seeds_;
+    std::vector<uint8_t> t_;
+    std::vector<uint64_t> y_;
+    std::vector<FieldT> buf_;
 };
 
-std::pair<DPFKey, DPFKey> Gen_point_zero(DomainIndex idx, uint32_t tree_height, uint32_t vector_dim, std::mt19937_64& rng);
+// V_b += sign * EvalFull(key) in one streaming pass over V_b, one
+// 2^chunk_log-leaf subtree at a time: no O(N) temporaries. V_b holds
+// N * vector_dim entries for any N <= 2^tree_height; items past N are pruned.
+void EvalFullAccumulate(const DPFKey& key, std::span<FieldT> V_b, int sign = 1,
+                        uint32_t chunk_log = DEFAULT_CHUNK_LOG);
+
+// Parallel EvalFullAccumulate: contiguous chunk ranges run as pool tasks
+// (thread_pool.hpp) and the result is identical to the serial call for any
+// pool size. No two tasks write the same cache line of V_b: the fragment of
+// a task's last line shared with its neighbour is added after the pool joins.
+void EvalFullAccumulate(const DPFKey& key, std::span<FieldT> V_b, int sign,
+                        WorkStealingPool& pool, uint32_t chunk_log = DEFAULT_CHUNK_LOG);
 
+// EvalFull on a pool
+std::vector<FieldT> EvalFull(const DPFKey& key, WorkStealingPool& pool, uint64_t num_items = ALL_ITEMS);
 
-std::vector<FieldT> EvalFull(const DPFKey& key);
+// V_b += sign * sum_k EvalFull(keys[k]) in one pass over V_b: per chunk,
+// every key is expanded into an accumulator that stays in cache and is added
+// to V_b once, so DB traffic is O(N * d) per batch instead of O(K * N * d).
+// Keys must share tree_height and vector_dim (and carry FCW_m already).
+void EvalFullAccumulateBatch(std::span<const DPFKey> keys, std::span<FieldT> V_b, int sign = 1,
+                             uint32_t chunk_log = DEFAULT_CHUNK_LOG);
+void EvalFullAccumulateBatch(std::span<const DPFKey> keys, std::span<FieldT> V_b, int sign,
+                             WorkStealingPool& pool, uint32_t chunk_log = DEFAULT_CHUNK_LOG);
+
+// Allocator of 64-byte aligned arrays: a vector that pool tasks write in
+// ranges starting at multiples of 8 words never has two tasks on one line
+template <class T>
+struct LineAllocator {
+    using value_type = T;
+    LineAllocator() = default;
+    template <class U>
+    LineAllocator(const LineAllocator<U>&) {}
+    T* allocate(size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(64))); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(64)); }
+    template <class U>
+    bool operator==(const LineAllocator<U>&) const { return true; }
+};
+
+// The part of an update that does not depend on the final correction word.
+// Item x's output is y[0..d) + FCW_m * y[d] with y shares of (r, 1) at the
+// target; PrepareEval has already added y[0..d) to V_b, and e[x] = y[d]
+// (with this party's sign and the update's sign applied) is what remains.
+struct PreparedEval {
+    uint64_t num_items;
+    uint32_t vector_dim;
+    // One word per item, line-aligned: the pool overload's tasks write
+    // ranges of whole 2^12-item chunks
+    std::vector<uint64_t, LineAllocator<uint64_t>> e;
+};
+
+// Expands a key as soon as it arrives, before the M_b - FCW_b exchange:
+// all of the AES work of the update happens here. V_b += sign * y[0..d) per
+// item, so V_b holds a partial update until FinishEvalAccumulate; read what
+// the exchange needs from V_b (the M_b inputs) first. Keeps 8 bytes per
+// item. Uses key.leaf_cw but not key.fcw. A pool splits the domain into
+// chunk ranges as in EvalFullAccumulate.
+PreparedEval PrepareEval(const DPFKey& key, std::span<FieldT> V_b, int sign = 1);
+PreparedEval PrepareEval(const DPFKey& key, std::span<FieldT> V_b, int sign, WorkStealingPool& pool);
+
+// Completes the update PrepareEval started on the same V_b: V_b += FCW_m *
+// e[x] per item, one multiply-add pass with no AES, so it is all that is
+// left on the critical path once FCW_m is known.
+void FinishEvalAccumulate(const PreparedEval& prep, std::span<const FieldT> FCW_m, std::span<FieldT> V_b);
+void FinishEvalAccumulate(const PreparedEval& prep, std::span<const FieldT> FCW_m, std::span<FieldT> V_b,
+                          WorkStealingPool& pool);
+
+// Two-server PIR over a public table that both servers hold (replicated, not
+// secret-shared): sum_i EvalFull(key)[i] * V[i] over V.size() / item_dim
+// items, item_dim words each, for a read key (Gen_point_read). The selector
+// is consumed as it is expanded, chunk by chunk, so only item_dim words are
+// returned and no N-entry vector exists. The two answers sum to item idx.
+// This does not read the additively shared V_b: sum_b <e_b, V_b> lacks the
+// cross terms <e_0, V_1> + <e_1, V_0>, which neither server can compute
+// alone. A pool splits the scan into chunk ranges and gives the same answer
+// as the serial call.
+std::vector<FieldT> EvalInnerProduct(const DPFKey& key, std::span<const FieldT> V, uint32_t item_dim,
+                                     uint32_t chunk_log = DEFAULT_CHUNK_LOG);
+std::vector<FieldT> EvalInnerProduct(const DPFKey& key, std::span<const FieldT> V, uint32_t item_dim,
+                                     WorkStealingPool& pool, uint32_t chunk_log = DEFAULT_CHUNK_LOG);
+
+// Splits a key at depth levels: key p of the 2^levels returned is a key of
+// height tree_height - levels whose EvalFull is items
+// [p << (tree_height - levels), (p + 1) << (tree_height - levels)) of
+// EvalFull(key). Costs 2^(levels+1) PRG calls, so a coordinator can hand each
+// shard of a prefix-sharded server just its subtree's seed and control bit.
+std::vector<DPFKey> SplitKey(const DPFKey& key, uint32_t levels);
+
+// Leaf and finish kernels are compiled for vector_dim 2, 4, 8, 16, 32 and 64
+// and picked from a table at run time, other dimensions use the generic
+// ones. Forcing the generic kernels (bench and tests) gives identical output.
+void use_generic_kernels(bool on);
+
+// Streaming-store path: the full-domain update loops (EvalFullAccumulate,
+// the batch, PrepareEval, FinishEvalAccumulate) write V_b with
+// non-temporal stores, which keeps a share array much larger than the cache
+// from evicting the per-chunk scratch. Output is identical; off by default.
+void use_streaming_stores(bool on);
 
 inline uint64_t domain_size_from_height(uint32_t h) {
     return (1ULL << h);
 }
 
-inline std::vector<FieldT> alloc_zero_flat(uint32_t tree_height, uint32_t vector_dim) {
-    uint64_t n = domain_size_from_height(tree_height);
-    std::vector<FieldT> z;
-    z.resize(n * vector_dim, FieldT(0));
-    return z;
 }
 
-} 
-
-#endif 
+#endif
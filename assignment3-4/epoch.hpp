@@ -0,0 +1,64 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "dpf.h"
+#include "thread_pool.hpp"
+
+namespace cs670 {
+
+// Epoch mode for one server: queues keys whose fcw already holds FCW_m and
+// applies them to V_b together with EvalFullAccumulateBatch, one pass over
+// V_b per epoch. An epoch closes when max_keys are pending or when the
+// oldest pending key has waited max_latency (checked on submit() and
+// poll(), so a caller without new keys should poll periodically).
+class UpdateEpoch {
+public:
+    using clock = std::chrono::steady_clock;
+
+    UpdateEpoch(std::span<FieldT> V_b, size_t max_keys, std::chrono::microseconds max_latency,
+                WorkStealingPool* pool = nullptr)
+        : V_b_(V_b), max_keys_(max_keys == 0 ? 1 : max_keys), max_latency_(max_latency), pool_(pool) {}
+
+    // Queues a key; returns true if this closed an epoch
+    bool submit(DPFKey key) {
+        if (pending_.empty()) oldest_ = clock::now();
+        pending_.push_back(std::move(key));
+        if (pending_.size() >= max_keys_ || clock::now() - oldest_ >= max_latency_) {
+            flush();
+            return true;
+        }
+        return false;
+    }
+
+    // Closes the epoch if its latency bound has passed
+    bool poll() {
+        if (pending_.empty() || clock::now() - oldest_ < max_latency_) return false;
+        flush();
+        return true;
+    }
+
+    void flush() {
+        if (pending_.empty()) return;
+        if (pool_) EvalFullAccumulateBatch(pending_, V_b_, 1, *pool_);
+        else EvalFullAccumulateBatch(pending_, V_b_);
+        pending_.clear();
+        ++epochs_;
+    }
+
+    size_t pending() const { return pending_.size(); }
+    size_t epochs() const { return epochs_; }
+
+private:
+    std::span<FieldT> V_b_;
+    size_t max_keys_;
+    std::chrono::microseconds max_latency_;
+    WorkStealingPool* pool_;
+    std::vector<DPFKey> pending_;
+    clock::time_point oldest_;
+    size_t epochs_ = 0;
+};
+
+}
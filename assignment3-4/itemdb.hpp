@@ -0,0 +1,211 @@
+#pragma once
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "dpf.h"
+#include "thread_pool.hpp"
+
+namespace cs670 {
+
+// One server's item shares on disk, mapped instead of rebuilt on every run.
+//
+// Layout: ItemDBHeader and one checksum per shard, padded to a 4 KiB page,
+// followed by the N * vector_dim share words, item-major as in V_b. Shards
+// are shard_items items each (a multiple of 8, so every shard starts on a
+// 64-byte line and the shards are contiguous: the whole table is one span).
+// Opening reads only the header pages; shard checksums are refreshed by
+// sync() and checked by verify(), both O(N * d).
+struct ItemDBHeader {
+    char magic[8];              // "CS670IDB"
+    uint32_t version;
+    uint32_t vector_dim;
+    uint64_t num_items;
+    int64_t scale;              // fixed-point SCALE the shares were written with
+    uint64_t shard_items;
+    uint64_t data_offset;       // bytes from the file start to item 0
+    uint64_t checksum;          // over the fields above and the shard checksums
+};
+static_assert(sizeof(ItemDBHeader) == 56);
+
+struct ItemDBOptions {
+    bool populate = false;      // MAP_POPULATE: fault the table in at open
+    bool hugepages = false;     // MADV_HUGEPAGE on the table (where the FS supports it)
+    uint64_t sync_every = 0;    // > 0: sync() after every sync_every updated() calls
+};
+
+class ItemShareDB {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint64_t DEFAULT_SHARD_ITEMS = 1ULL << 16;
+
+    using Options = ItemDBOptions;
+
+    // Creates (or truncates) a zero-filled table of num_items items
+    static ItemShareDB create(const std::string& path, uint64_t num_items, uint32_t vector_dim,
+                              Options opt = {}, uint64_t shard_items = DEFAULT_SHARD_ITEMS) {
+        if (num_items == 0 || vector_dim == 0 || shard_items == 0 || shard_items % 8 != 0)
+            throw std::invalid_argument("item DB needs items, a dimension and shards of 8k items");
+        uint64_t offset = data_offset((num_items + shard_items - 1) / shard_items);
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw_errno("open " + path);
+        ItemShareDB db(fd, opt);
+        if (::ftruncate(fd, (off_t)(offset + num_items * vector_dim * sizeof(FieldT))) != 0)
+            throw_errno("ftruncate " + path);
+        db.map();
+
+        ItemDBHeader& h = db.header();
+        std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+        h.version = VERSION;
+        h.vector_dim = vector_dim;
+        h.num_items = num_items;
+        h.scale = SCALE;
+        h.shard_items = shard_items;
+        h.data_offset = offset;
+        db.sync();
+        return db;
+    }
+
+    // Maps an existing table; only the header pages are read and checked
+    static ItemShareDB open(const std::string& path, Options opt = {}) {
+        int fd = ::open(path.c_str(), O_RDWR);
+        if (fd < 0) throw_errno("open " + path);
+        ItemShareDB db(fd, opt);
+        db.map();
+
+        const ItemDBHeader& h = db.header();
+        if (std::memcmp(h.magic, MAGIC, sizeof(h.magic)) != 0 || h.version != VERSION)
+            throw std::runtime_error(path + ": not a version " + std::to_string(VERSION) + " item DB");
+        if (h.scale != SCALE || h.shard_items == 0 || h.data_offset != data_offset(db.shards()) ||
+            db.bytes_ != h.data_offset + h.num_items * h.vector_dim * sizeof(FieldT) ||
+            h.checksum != db.header_checksum())
+            throw std::runtime_error(path + ": corrupt or incompatible item DB header");
+        return db;
+    }
+
+    ItemShareDB(ItemShareDB&& o) noexcept
+        : fd_(std::exchange(o.fd_, -1)), base_(std::exchange(o.base_, nullptr)),
+          bytes_(o.bytes_), opt_(o.opt_), updates_(o.updates_) {}
+    ItemShareDB& operator=(ItemShareDB&&) = delete;
+    ItemShareDB(const ItemShareDB&) = delete;
+
+    // Unmaps without syncing: dirty pages still reach the file via the page
+    // cache, but the shard checksums are only current after sync()
+    ~ItemShareDB() {
+        if (base_) ::munmap(base_, bytes_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    uint64_t num_items() const { return header().num_items; }
+    uint32_t vector_dim() const { return header().vector_dim; }
+    uint64_t shards() const { return (num_items() + shard_items() - 1) / shard_items(); }
+    uint64_t shard_items() const { return header().shard_items; }
+
+    // The whole table as V_b: item x at items()[x*vector_dim ..]
+    std::span<FieldT> items() {
+        return {reinterpret_cast<FieldT*>(base_ + header().data_offset), num_items() * vector_dim()};
+    }
+    std::span<const FieldT> items() const {
+        return {reinterpret_cast<const FieldT*>(base_ + header().data_offset), num_items() * vector_dim()};
+    }
+
+    std::span<FieldT> shard(uint64_t s) {
+        uint64_t lo = s * shard_items(), n = std::min(shard_items(), num_items() - lo);
+        return items().subspan(lo * vector_dim(), n * vector_dim());
+    }
+
+    // Call after each in-place update; syncs every Options::sync_every calls
+    void updated(WorkStealingPool* pool = nullptr) {
+        if (opt_.sync_every > 0 && ++updates_ % opt_.sync_every == 0) sync(pool);
+    }
+
+    // Refreshes the shard checksums (one pool task per shard) and
+    // writes the mapping back with msync(MS_SYNC)
+    void sync(WorkStealingPool* pool = nullptr) {
+        uint64_t* sums = shard_sums();
+        auto one = [&](size_t s) { sums[s] = shard_checksum(s); };
+        if (pool) pool->run(shards(), one);
+        else for (uint64_t s = 0; s < shards(); s++) one(s);
+        header().checksum = header_checksum();
+        if (::msync(base_, bytes_, MS_SYNC) != 0) throw_errno("msync");
+    }
+
+    // True if every shard matches the checksum recorded by the last sync()
+    bool verify() const {
+        for (uint64_t s = 0; s < shards(); s++) {
+            if (shard_sums()[s] != shard_checksum(s)) return false;
+        }
+        return true;
+    }
+
+private:
+    static constexpr size_t PAGE = 4096;
+    static constexpr char MAGIC[8] = {'C', 'S', '6', '7', '0', 'I', 'D', 'B'};
+
+    ItemShareDB(int fd, Options opt) : fd_(fd), opt_(opt) {}
+
+    static uint64_t data_offset(uint64_t shards) {
+        return (sizeof(ItemDBHeader) + 8 * shards + PAGE - 1) / PAGE * PAGE;
+    }
+
+    [[noreturn]] static void throw_errno(const std::string& what) {
+        throw std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    void map() {
+        struct stat st;
+        if (::fstat(fd_, &st) != 0) throw_errno("fstat");
+        bytes_ = (size_t)st.st_size;
+        if (bytes_ < data_offset(0)) throw std::runtime_error("item DB smaller than its header");
+        int flags = MAP_SHARED | (opt_.populate ? MAP_POPULATE : 0);
+        void* p = ::mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, flags, fd_, 0);
+        if (p == MAP_FAILED) throw_errno("mmap");
+        base_ = static_cast<unsigned char*>(p);
+        // A hint only: ignored where the file system has no large folios
+        if (opt_.hugepages) ::madvise(base_, bytes_, MADV_HUGEPAGE);
+    }
+
+    ItemDBHeader& header() { return *reinterpret_cast<ItemDBHeader*>(base_); }
+    const ItemDBHeader& header() const { return *reinterpret_cast<const ItemDBHeader*>(base_); }
+    uint64_t* shard_sums() { return reinterpret_cast<uint64_t*>(base_ + sizeof(ItemDBHeader)); }
+    const uint64_t* shard_sums() const { return reinterpret_cast<const uint64_t*>(base_ + sizeof(ItemDBHeader)); }
+
+    // FNV-1a style over 64-bit words
+    static uint64_t mix(uint64_t h, const uint64_t* w, uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) h = (h ^ w[i]) * 0x100000001b3ULL;
+        return h;
+    }
+
+    uint64_t shard_checksum(uint64_t s) const {
+        uint64_t lo = s * shard_items(), n = std::min(shard_items(), num_items() - lo);
+        const uint64_t* w = reinterpret_cast<const uint64_t*>(items().data()) + lo * vector_dim();
+        return mix(0xcbf29ce484222325ULL ^ s, w, n * vector_dim());
+    }
+
+    uint64_t header_checksum() const {
+        const ItemDBHeader& h = header();
+        uint64_t fields[] = {h.version, h.vector_dim, h.num_items, (uint64_t)h.scale, h.shard_items, h.data_offset};
+        uint64_t c = mix(0xcbf29ce484222325ULL, fields, 6);
+        return mix(c, shard_sums(), shards());
+    }
+
+    int fd_ = -1;
+    unsigned char* base_ = nullptr;
+    size_t bytes_ = 0;
+    Options opt_;
+    uint64_t updates_ = 0;
+};
+
+}
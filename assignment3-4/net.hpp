@@ -0,0 +1,129 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include <spawn.h>
+
+extern char** environ;
+
+namespace cs670 {
+
+using boost::asio::ip::tcp;
+
+// Length-prefixed frames over a blocking TCP socket: 1-byte op, 4-byte
+// little-endian payload length, payload
+struct Frame {
+    uint8_t op = 0;
+    std::vector<uint8_t> payload;
+};
+
+inline void send_frame(tcp::socket& sock, uint8_t op, std::span<const uint8_t> payload = {}) {
+    uint32_t n = (uint32_t)payload.size();
+    uint8_t hdr[5] = {op, (uint8_t)n, (uint8_t)(n >> 8), (uint8_t)(n >> 16), (uint8_t)(n >> 24)};
+    std::array<boost::asio::const_buffer, 2> bufs = {boost::asio::buffer(hdr),
+                                                     boost::asio::buffer(payload.data(), payload.size())};
+    boost::asio::write(sock, bufs);
+}
+
+// Into f, reusing its payload's capacity across frames
+inline void recv_frame(tcp::socket& sock, Frame& f) {
+    uint8_t hdr[5];
+    boost::asio::read(sock, boost::asio::buffer(hdr));
+    f.op = hdr[0];
+    f.payload.resize(hdr[1] | (hdr[2] << 8) | (hdr[3] << 16) | ((uint32_t)hdr[4] << 24));
+    boost::asio::read(sock, boost::asio::buffer(f.payload));
+}
+
+inline Frame recv_frame(tcp::socket& sock) {
+    Frame f;
+    recv_frame(sock, f);
+    return f;
+}
+
+// Connects to host:port, retrying while the peer is still starting up
+inline tcp::socket connect_retry(boost::asio::io_context& io, const std::string& host, uint16_t port,
+                                 std::chrono::milliseconds timeout = std::chrono::seconds(10)) {
+    tcp::resolver resolver(io);
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    for (;;) {
+        tcp::socket sock(io);
+        boost::system::error_code ec;
+        boost::asio::connect(sock, resolver.resolve(host, std::to_string(port)), ec);
+        if (!ec) {
+            sock.set_option(tcp::no_delay(true));
+            return sock;
+        }
+        if (std::chrono::steady_clock::now() > deadline)
+            throw std::runtime_error("connect " + host + ":" + std::to_string(port) + ": " + ec.message());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+}
+
+// Both ends of a loopback connection, for running two parties in one process
+inline std::pair<tcp::socket, tcp::socket> loopback_pair(boost::asio::io_context& io) {
+    tcp::acceptor acceptor(io, {boost::asio::ip::address_v4::loopback(), 0});
+    tcp::socket a(io);
+    a.connect(acceptor.local_endpoint());
+    tcp::socket b = acceptor.accept();
+    a.set_option(tcp::no_delay(true));
+    b.set_option(tcp::no_delay(true));
+    return {std::move(a), std::move(b)};
+}
+
+// Little-endian payload fields
+inline void put_u32(std::vector<uint8_t>& buf, uint32_t x) {
+    for (int i = 0; i < 4; i++) buf.push_back((uint8_t)(x >> (8 * i)));
+}
+
+inline void put_u64(std::vector<uint8_t>& buf, uint64_t x) {
+    for (int i = 0; i < 8; i++) buf.push_back((uint8_t)(x >> (8 * i)));
+}
+
+inline uint64_t get_u64(const uint8_t* p, int bytes = 8) {
+    uint64_t x = 0;
+    for (int i = 0; i < bytes; i++) x |= (uint64_t)p[i] << (8 * i);
+    return x;
+}
+
+// Ops of one server's prefix-sharded item store, spoken by the driver to
+// that server's shard_coord and by shard_coord to its shard_servers
+enum ShardOp : uint8_t {
+    SHARD_UPDATE = 1,   // serialized k_b (subtree key, to a shard) -> SHARD_ACK: u64 updates applied
+    SHARD_SUM = 2,      // -> SHARD_ACK: sum of all V_b words (mod 2^64)
+    SHARD_GET = 3,      // u64 item -> SHARD_ACK: its V_b words
+    SHARD_QUIT = 4,
+    SHARD_ACK = 5,
+};
+
+// Starts the program <name> from this executable's directory with the
+// given arguments, for --spawn runs that keep every process on this host
+inline pid_t spawn_sibling(const std::string& name, const std::vector<std::string>& args) {
+    std::string exe = (std::filesystem::read_symlink("/proc/self/exe").parent_path() / name).string();
+    std::vector<std::string> all = {exe};
+    all.insert(all.end(), args.begin(), args.end());
+    std::vector<char*> cargs;
+    for (auto& a : all) cargs.push_back(a.data());
+    cargs.push_back(nullptr);
+    pid_t pid;
+    if (posix_spawn(&pid, exe.c_str(), nullptr, nullptr, cargs.data(), environ) != 0)
+        throw std::runtime_error("cannot start " + exe);
+    return pid;
+}
+
+// Ops of the networked XOR-to-additive conversion (conversion.h)
+enum ConvOp : uint8_t {
+    CONV_HELLO = 16,    // u64 words, u64 chunk_words; must equal the peer's
+    CONV_CHUNK = 17,    // party 0 -> party 1: D0 - S words of one chunk
+};
+
+}
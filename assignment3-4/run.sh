@@ -8,7 +8,10 @@ make
 echo "[2] Running unit test..."
 ./test_protocol
 
-echo "[3] Running benchmark..."
+echo "[3] Running two servers of 4 shard processes each over loopback..."
+./shard_driver 4 4 16 32 --spawn
+
+echo "[4] Running benchmark..."
 ./bench --items 1024 --dim 4 --runs 10 > outputs.csv
 
 echo "Done. Results saved to outputs.csv"
@@ -1,13 +1,22 @@
 #include "dpf.h"
-#include "conversion.h"
+#include "csprng.hpp"
+#include "thread_pool.hpp"
+#include "itemdb.hpp"
+#include "arena.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <vector>
-#include <random>
 #include <cassert>
 #include <chrono>
 #include <cstring>
+#include <span>
+#include <thread>
+#include <future>
+#include <optional>
+#include <cerrno>
+
+#include <sys/stat.h>
 
 using namespace cs670;
 
@@ -53,7 +62,7 @@ std::vector<double> fp_to_double_vec(const std::vector<FieldT>& v) {
     return out;
 }
 
-std::vector<FieldT> reconstruct_item(const std::vector<FieldT>& V0, const std::vector<FieldT>& V1, uint32_t vector_dim, uint64_t j) {
+std::vector<FieldT> reconstruct_item(std::span<const FieldT> V0, std::span<const FieldT> V1, uint32_t vector_dim, uint64_t j) {
     std::vector<FieldT> out(vector_dim);
     for (uint32_t d = 0; d < vector_dim; ++d) {
         out[d] = V0[flat_index(j, vector_dim, d)] + V1[flat_index(j, vector_dim, d)];
@@ -61,17 +70,65 @@ std::vector<FieldT> reconstruct_item(const std::vector<FieldT>& V0, const std::v
     return out;
 }
 
+// Toy item t, coordinate d, in fixed point
+FieldT toy_item(uint64_t t, uint32_t d) {
+    return (FieldT)std::llround(((double)(t + 1) + 0.1 * double(d + 1)) * (double)SCALE);
+}
+
+// Fills V0/V1 with additive shares of the toy DB. Server 0's share of entry
+// i is element i of one keyed mask stream (CtrPrg), so each pool task draws
+// its own item range at its offset and the shares do not depend on the
+// thread count.
+void fill_toy_db(std::span<FieldT> V0, std::span<FieldT> V1, uint32_t vector_dim, WorkStealingPool& pool) {
+    unsigned char mask_key[16];
+    csprng().fill(std::span<unsigned char>(mask_key));
+    const CtrPrg mask_prg(mask_key);
+    uint64_t items = V0.size() / vector_dim;
+    size_t tasks = pool.size();
+    pool.run(tasks, [&](size_t k) {
+        uint64_t lo = k * items / tasks, hi = (k + 1) * items / tasks;
+        mask_prg.fill(V0.subspan(lo * vector_dim, (hi - lo) * vector_dim), lo * vector_dim);
+        for (uint64_t t = lo; t < hi; ++t) {
+            for (uint32_t d = 0; d < vector_dim; ++d) {
+                FieldT r = V0[flat_index(t, vector_dim, d)] & 0x7FFFFFFFFFFFFFFFLL;
+                V0[flat_index(t, vector_dim, d)] = r;
+                V1[flat_index(t, vector_dim, d)] = toy_item(t, d) - r;
+            }
+        }
+    });
+}
+
 int main(int argc, char** argv) {
-    if (argc < 6) {
-        std::cerr << "Usage: " << argv[0] << " <k0_file> <k1_file> <vector_dim> <tree_height> <index_j>\n";
+    std::vector<std::string> pos;
+    std::string db_prefix;
+    bool init_db = false;       // --init: (re)create the DB files even if they exist
+    ItemShareDB::Options db_opt;
+    db_opt.sync_every = 1;      // one update per run: sync it unless told otherwise
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--db" && i + 1 < argc) db_prefix = argv[++i];
+        else if (a == "--init") init_db = true;
+        else if (a == "--populate") db_opt.populate = true;
+        else if (a == "--hugepages") db_opt.hugepages = true;
+        else if (a == "--sync-every" && i + 1 < argc) db_opt.sync_every = std::stoull(argv[++i]);
+        else pos.push_back(a);
+    }
+    if (pos.size() < 5) {
+        std::cerr << "Usage: " << argv[0] << " <k0_file> <k1_file> <vector_dim> <tree_height> <index_j> [threads] [rtt_ms]"
+                  << " [--db <prefix> [--init] [--populate] [--hugepages] [--sync-every K]]\n";
         return 1;
     }
 
-    std::string k0_file = argv[1];
-    std::string k1_file = argv[2];
-    uint32_t vector_dim = static_cast<uint32_t>(std::stoul(argv[3]));
-    uint32_t tree_height = static_cast<uint32_t>(std::stoul(argv[4]));
-    uint64_t idx_j = std::stoull(argv[5]);
+    std::string k0_file = pos[0];
+    std::string k1_file = pos[1];
+    uint32_t vector_dim = static_cast<uint32_t>(std::stoul(pos[2]));
+    uint32_t tree_height = static_cast<uint32_t>(std::stoul(pos[3]));
+    uint64_t idx_j = std::stoull(pos[4]);
+    unsigned threads = pos.size() > 5 ? static_cast<unsigned>(std::stoul(pos[5])) : std::thread::hardware_concurrency();
+    // rtt_ms given: simulate the FCW exchange's round trip and overlap it with
+    // the key expansion (PrepareEval) instead of evaluating afterwards
+    bool overlap = pos.size() > 6;
+    unsigned rtt_ms = overlap ? static_cast<unsigned>(std::stoul(pos[6])) : 0;
 
     std::vector<uint8_t> kb0_bytes, kb1_bytes;
     if (!read_file_bytes(k0_file, kb0_bytes) || !read_file_bytes(k1_file, kb1_bytes)) {
@@ -81,6 +138,10 @@ int main(int argc, char** argv) {
     DPFKey k0 = DPFKey::deserialize(kb0_bytes);
     DPFKey k1 = DPFKey::deserialize(kb1_bytes);
 
+    if (k0.tree_height != tree_height || k1.tree_height != tree_height) {
+        std::cerr << "Key tree_height mismatch. Expected " << tree_height << "\n";
+        return 1;
+    }
     if (k0.fcw.size() != vector_dim || k1.fcw.size() != vector_dim) {
         std::cerr << "Key FCW vector_dim mismatch. Expected " << vector_dim << "\n";
         return 1;
@@ -93,23 +154,59 @@ int main(int argc, char** argv) {
     }
 
     // ---------------------------
-    // Setup toy item database (additive shares V0, V1)
+    // Item database (additive shares V0, V1): a fresh toy DB in RAM, or with
+    // --db each server's share file <prefix>.s0 / .s1, mapped and updated in
+    // place. The toy DB is written only when neither file exists yet or with
+    // --init; a file that cannot be opened or does not match N and d is an
+    // error, never silently replaced.
     // ---------------------------
-    std::vector<FieldT> V0(domain_size * (uint64_t)vector_dim);
-    std::vector<FieldT> V1(domain_size * (uint64_t)vector_dim);
-
-    std::mt19937_64 rng(0xC0FFEE);
-    for (uint64_t t = 0; t < domain_size; ++t) {
-        std::vector<double> item_d(vector_dim);
-        for (uint32_t d = 0; d < vector_dim; ++d) {
-            item_d[d] = (double)(t + 1) + 0.1 * double(d + 1); 
-        }
-        std::vector<FieldT> item_fp = fp_from_double_vec(item_d);
-        for (uint32_t d = 0; d < vector_dim; ++d) {
-            FieldT r = (FieldT)(rng() & 0x7FFFFFFFFFFFFFFFLL);
-            V0[flat_index(t, vector_dim, d)] = r;
-            V1[flat_index(t, vector_dim, d)] = item_fp[d] - r;
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::duration d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    WorkStealingPool pool(threads);
+    ShareBuffer V0_mem, V1_mem;
+    std::optional<ItemShareDB> db0, db1;
+    std::span<FieldT> V0, V1;
+    if (db_prefix.empty()) {
+        // Huge pages, first touched by the workers that update them
+        V0_mem = ShareBuffer(domain_size * (uint64_t)vector_dim, {}, &pool);
+        V1_mem = ShareBuffer(domain_size * (uint64_t)vector_dim, {}, &pool);
+        fill_toy_db(V0_mem, V1_mem, vector_dim, pool);
+        V0 = V0_mem;
+        V1 = V1_mem;
+    } else {
+        auto t_open = clock::now();
+        auto missing = [](const std::string& path) {
+            struct stat st;
+            return ::stat(path.c_str(), &st) != 0 && errno == ENOENT;
+        };
+        bool fresh = init_db || (missing(db_prefix + ".s0") && missing(db_prefix + ".s1"));
+        if (!fresh) {
+            try {
+                db0.emplace(ItemShareDB::open(db_prefix + ".s0", db_opt));
+                db1.emplace(ItemShareDB::open(db_prefix + ".s1", db_opt));
+            } catch (const std::exception& e) {
+                std::cerr << "Cannot open item DB: " << e.what() << " (--init recreates it)\n";
+                return 1;
+            }
+            for (const ItemShareDB* db : {&*db0, &*db1}) {
+                if (db->num_items() != domain_size || db->vector_dim() != vector_dim) {
+                    std::cerr << "Item DB " << db_prefix << " holds " << db->num_items() << " items of dimension "
+                              << db->vector_dim() << ", not " << domain_size << " of " << vector_dim
+                              << " (--init recreates it)\n";
+                    return 1;
+                }
+            }
+        } else {
+            db0.emplace(ItemShareDB::create(db_prefix + ".s0", domain_size, vector_dim, db_opt));
+            db1.emplace(ItemShareDB::create(db_prefix + ".s1", domain_size, vector_dim, db_opt));
+            fill_toy_db(db0->items(), db1->items(), vector_dim, pool);
+            db0->sync(&pool);
+            db1->sync(&pool);
         }
+        std::cout << (fresh ? "Created" : "Opened") << " item DB " << db_prefix << ".s0/.s1 in "
+                  << ms(clock::now() - t_open) << " ms\n";
+        V0 = db0->items();
+        V1 = db1->items();
     }
 
     std::vector<double> u_real_double(vector_dim);
@@ -118,6 +215,16 @@ int main(int argc, char** argv) {
     }
     std::vector<FieldT> u_fp = fp_from_double_vec(u_real_double); 
 
+    // Reconstructed DB before the update, kept only for the exactness check
+    // (a mapped DB is checked against the keys' own outputs instead, in
+    // constant memory)
+    std::vector<FieldT> before;
+    if (db_prefix.empty()) {
+        before.resize(V0.size());
+        for (size_t i = 0; i < V0.size(); ++i) before[i] = V0[i] + V1[i];
+    }
+    std::vector<FieldT> vj_before = reconstruct_item(V0, V1, vector_dim, idx_j);
+
     std::vector<FieldT> V0_item(vector_dim), V1_item(vector_dim);
     for (uint32_t d = 0; d < vector_dim; ++d) {
         V0_item[d] = V0[flat_index(idx_j, vector_dim, d)];
@@ -140,35 +247,85 @@ int main(int argc, char** argv) {
         masked1[d] = M1[d] - k1.fcw[d];
     }
 
+    // The masked words are sent: the keys' expansion does not depend on
+    // FCW_m, so in overlap mode it runs on the pool while the round is in
+    // flight (it adds to V_b, hence only after M_b has been read from it)
+    auto t_start = clock::now();
+    std::future<std::pair<PreparedEval, PreparedEval>> prep;
+    if (overlap) {
+        prep = std::async(std::launch::async, [&] {
+            PreparedEval p0 = PrepareEval(k0, V0, 1, pool);
+            return std::make_pair(std::move(p0), PrepareEval(k1, V1, 1, pool));
+        });
+    }
+
+    // Exchange of masked0 / masked1
+    if (overlap) std::this_thread::sleep_for(std::chrono::milliseconds(rtt_ms));
+
     std::vector<FieldT> FCW_m(vector_dim);
     for (uint32_t d = 0; d < vector_dim; ++d) {
         FCW_m[d] = masked0[d] + masked1[d]; 
     }
+    auto t_round = clock::now();
+
+    if (overlap) {
+        // Only the FCW_m multiply-add remains once the round completes
+        auto [p0, p1] = prep.get();
+        auto t_ready = clock::now();
+        FinishEvalAccumulate(p0, FCW_m, V0, pool);
+        FinishEvalAccumulate(p1, FCW_m, V1, pool);
+        auto t_done = clock::now();
+        std::cout << "Overlap: round " << ms(t_round - t_start) << " ms, expansion ready after "
+                  << ms(t_ready - t_start) << " ms, finish " << ms(t_done - t_ready) << " ms, total "
+                  << ms(t_done - t_start) << " ms\n";
+    } else {
+        k0.fcw = FCW_m;
+        k1.fcw = FCW_m;
 
-    k0.fcw = masked0;
-    k1.fcw.resize(vector_dim);
-    for (uint32_t d = 0; d < vector_dim; d++) k1.fcw[d] = (FieldT)0 - masked1[d];
-
-
-    std::vector<FieldT> D0 = EvalFull(k0);
-    std::vector<FieldT> D1 = EvalFull(k1);
-    std::vector<FieldT> A0_baseline(D0.size()), A1_baseline(D1.size());
-    baseline_xor_to_additive(D0, 0, A0_baseline);
-    baseline_xor_to_additive(D1, 1, A1_baseline);
+        // Each server streams its DPF output straight into its share array,
+        // chunk ranges spread over the pool
+        EvalFullAccumulate(k0, V0, 1, pool);
+        EvalFullAccumulate(k1, V1, 1, pool);
+    }
+    if (db0) {
+        db0->updated(&pool);
+        db1->updated(&pool);
+    }
 
-    for (size_t i = 0; i < V0.size(); ++i) {
-        V0[i] = V0[i] + A0_baseline[i];
-        V1[i] = V1[i] + A1_baseline[i];
+    // The DPF part is exact (mod 2^64): the update is M0 + M1 at item j, zero elsewhere
+    bool dpf_exact = true;
+    if (!before.empty()) {
+        for (uint64_t t = 0; t < domain_size; ++t) {
+            for (uint32_t d = 0; d < vector_dim; ++d) {
+                uint64_t i = flat_index(t, vector_dim, d);
+                uint64_t got = (uint64_t)V0[i] + (uint64_t)V1[i] - (uint64_t)before[i];
+                uint64_t want = t == idx_j ? (uint64_t)M0[d] + (uint64_t)M1[d] : 0;
+                if (got != want) dpf_exact = false;
+            }
+        }
+    } else {
+        k0.fcw = FCW_m;
+        k1.fcw = FCW_m;
+        EvalFullStream s0(k0), s1(k1);
+        EvalChunk c0, c1;
+        std::vector<FieldT> sum;
+        while (s0.next(c0)) {
+            sum.assign(c0.values.begin(), c0.values.end());
+            s1.next(c1);
+            for (uint64_t x = 0; x < c0.items; ++x) {
+                for (uint32_t d = 0; d < vector_dim; ++d) {
+                    uint64_t i = flat_index(x, vector_dim, d);
+                    uint64_t got = (uint64_t)sum[i] + (uint64_t)c1.values[i];
+                    uint64_t want = c0.offset + x == idx_j ? (uint64_t)M0[d] + (uint64_t)M1[d] : 0;
+                    if (got != want) dpf_exact = false;
+                }
+            }
+        }
     }
+    std::cout << "DPF update is M0 + M1 at j and zero elsewhere: " << (dpf_exact ? "yes" : "NO") << "\n";
 
     std::vector<FieldT> vj_after = reconstruct_item(V0, V1, vector_dim, idx_j);
 
-    std::vector<double> item_d_orig(vector_dim);
-    for (uint32_t d = 0; d < vector_dim; ++d) {
-        item_d_orig[d] = (double)(idx_j + 1) + 0.1 * double(d + 1);
-    }
-    std::vector<FieldT> item_fp_orig = fp_from_double_vec(item_d_orig);
-
     std::vector<FieldT> expected_M(vector_dim);
     FieldT alpha_full = alpha0 + alpha1;
     for (uint32_t d = 0; d < vector_dim; ++d) {
@@ -177,7 +334,7 @@ int main(int argc, char** argv) {
 
     std::vector<FieldT> expected_v_after(vector_dim);
     for (uint32_t d = 0; d < vector_dim; ++d) {
-        expected_v_after[d] = item_fp_orig[d] + expected_M[d];
+        expected_v_after[d] = vj_before[d] + expected_M[d];
     }
 
     std::vector<double> v_after_d = fp_to_double_vec(vj_after);
@@ -196,9 +353,9 @@ int main(int argc, char** argv) {
         }
     }
     if (ok) {
-        std::cout << "Verification PASSED (baseline conversion within tolerance).\n";
+        std::cout << "Verification PASSED (within tolerance).\n";
     } else {
-        std::cout << "Verification FAILED (baseline conversion disagreement).\n";
+        std::cout << "Verification FAILED (fixed-point disagreement).\n";
     }
 
     return 0;
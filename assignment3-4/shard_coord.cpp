@@ -0,0 +1,130 @@
+// Coordinator of one server's prefix-sharded item store. It receives that
+// server's keys k_b only, splits each at depth log2(S) (SplitKey) and
+// forwards subtree p's key to shard p, which owns items
+// [p * N/S, (p + 1) * N/S) of V_b. Sums and item reads are routed to the
+// shards the same way. With --spawn it starts its S shard_server processes
+// on this host itself.
+#include "dpf.h"
+#include "net.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+
+#include <sys/wait.h>
+
+using namespace cs670;
+
+int main(int argc, char** argv) {
+    std::vector<std::string> pos, shard_hosts;
+    std::string bind = "127.0.0.1";
+    bool spawn = false;
+    unsigned shard_threads = 1;
+    int shard_port_arg = -1;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--spawn") spawn = true;
+        else if (a == "--bind" && i + 1 < argc) bind = argv[++i];
+        else if (a == "--shard-host" && i + 1 < argc) shard_hosts.push_back(argv[++i]);
+        else if (a == "--shard-port" && i + 1 < argc) shard_port_arg = std::stoi(argv[++i]);
+        else if (a == "--threads" && i + 1 < argc) shard_threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        else pos.push_back(a);
+    }
+    if (pos.size() < 4) {
+        std::cerr << "Usage: " << argv[0] << " <port> <shards> <vector_dim> <tree_height>"
+                  << " [--shard-port P] [--shard-host H]... [--bind ADDR] [--spawn] [--threads T]\n"
+                  << "Shard p listens on port P + p (default port + 1 + p) of the p-th --shard-host"
+                  << " (one host for all shards if given once; default 127.0.0.1).\n";
+        return 1;
+    }
+    uint16_t port = static_cast<uint16_t>(std::stoul(pos[0]));
+    uint64_t shards = std::stoull(pos[1]);
+    uint32_t vector_dim = static_cast<uint32_t>(std::stoul(pos[2]));
+    uint32_t tree_height = static_cast<uint32_t>(std::stoul(pos[3]));
+    uint16_t shard_port = shard_port_arg >= 0 ? static_cast<uint16_t>(shard_port_arg) : static_cast<uint16_t>(port + 1);
+
+    uint32_t split = shards > 1 ? 64 - __builtin_clzll(shards - 1) : 0;
+    if (shards == 0 || (1ULL << split) != shards || split > tree_height) {
+        std::cerr << "Shard count must be a power of two <= 2^tree_height.\n";
+        return 1;
+    }
+    if (shard_hosts.empty()) shard_hosts.push_back("127.0.0.1");
+    if (shard_hosts.size() != 1 && shard_hosts.size() != shards) {
+        std::cerr << "Give --shard-host once or once per shard.\n";
+        return 1;
+    }
+    uint32_t sub_height = tree_height - split;
+    uint64_t sub_items = domain_size_from_height(sub_height);
+
+    std::vector<pid_t> pids;
+    bool ok = true;
+    try {
+        if (spawn) {
+            for (uint64_t p = 0; p < shards; ++p)
+                pids.push_back(spawn_sibling("shard_server",
+                                             {std::to_string(shard_port + p), std::to_string(p),
+                                              std::to_string(shards), std::to_string(vector_dim),
+                                              std::to_string(tree_height), std::to_string(shard_threads)}));
+        }
+
+        boost::asio::io_context io;
+        std::vector<tcp::socket> socks;
+        for (uint64_t p = 0; p < shards; ++p)
+            socks.push_back(connect_retry(io, shard_hosts[shard_hosts.size() == 1 ? 0 : p], (uint16_t)(shard_port + p)));
+
+        tcp::acceptor acceptor(io, {boost::asio::ip::make_address(bind), port});
+        tcp::socket front = acceptor.accept();
+        front.set_option(tcp::no_delay(true));
+
+        // Every shard request is sent to all shards first and answered after,
+        // so the shards apply an update concurrently
+        auto expect_ack = [&](uint64_t p) {
+            Frame f = recv_frame(socks[p]);
+            if (f.op != SHARD_ACK) throw std::runtime_error("shard " + std::to_string(p) + " failed");
+            return f;
+        };
+        uint64_t applied = 0;
+        for (;;) {
+            Frame f = recv_frame(front);
+            std::vector<uint8_t> reply;
+            if (f.op == SHARD_UPDATE) {
+                DPFKey k = DPFKey::deserialize(f.payload);
+                if (k.tree_height != tree_height || k.fcw.size() != vector_dim)
+                    throw std::runtime_error("key does not match this server's store");
+                std::vector<DPFKey> parts = SplitKey(k, split);
+                for (uint64_t p = 0; p < shards; ++p) send_frame(socks[p], SHARD_UPDATE, parts[p].serialize());
+                for (uint64_t p = 0; p < shards; ++p) expect_ack(p);
+                put_u64(reply, ++applied);
+            } else if (f.op == SHARD_SUM) {
+                uint64_t sum = 0;
+                for (uint64_t p = 0; p < shards; ++p) send_frame(socks[p], SHARD_SUM);
+                for (uint64_t p = 0; p < shards; ++p) sum += get_u64(expect_ack(p).payload.data());
+                put_u64(reply, sum);
+            } else if (f.op == SHARD_GET && f.payload.size() == 8) {
+                uint64_t x = get_u64(f.payload.data());
+                if (x >= domain_size_from_height(tree_height)) throw std::runtime_error("item outside the domain");
+                std::vector<uint8_t> q;
+                put_u64(q, x & (sub_items - 1));
+                send_frame(socks[x >> sub_height], SHARD_GET, q);
+                reply = expect_ack(x >> sub_height).payload;
+            } else if (f.op == SHARD_QUIT) {
+                break;
+            } else {
+                throw std::runtime_error("unknown op " + std::to_string(f.op));
+            }
+            send_frame(front, SHARD_ACK, reply);
+        }
+        for (auto& s : socks) send_frame(s, SHARD_QUIT);
+    } catch (const std::exception& e) {
+        std::cerr << "[coordinator " << port << "] " << e.what() << "\n";
+        ok = false;
+    }
+
+    for (pid_t pid : pids) {
+        int status;
+        if (!ok) kill(pid, SIGTERM);
+        waitpid(pid, &status, 0);
+    }
+    return ok ? 0 : 1;
+}
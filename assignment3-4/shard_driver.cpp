@@ -0,0 +1,164 @@
+// Test driver for the prefix-sharded deployment: plays the user, who makes
+// the update keys, and the verifier, who checks the result. Each update's
+// k0 goes to server 0's shard_coord and k1 to server 1's, so neither server
+// (nor any of its shards) sees both keys. Afterwards the two servers' sums
+// and every updated item are reconstructed here. With --spawn it starts both
+// coordinators (and through them their shards) on this host.
+#include "dpf.h"
+#include "csprng.hpp"
+#include "net.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <cstring>
+
+#include <sys/wait.h>
+
+using namespace cs670;
+
+int main(int argc, char** argv) {
+    std::vector<std::string> pos;
+    std::string hosts[2] = {"127.0.0.1", "127.0.0.1"};
+    bool spawn = false;
+    unsigned shard_threads = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--spawn") spawn = true;
+        else if (a == "--host0" && i + 1 < argc) hosts[0] = argv[++i];
+        else if (a == "--host1" && i + 1 < argc) hosts[1] = argv[++i];
+        else if (a == "--threads" && i + 1 < argc) shard_threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        else pos.push_back(a);
+    }
+    if (pos.size() < 4) {
+        std::cerr << "Usage: " << argv[0] << " <shards> <vector_dim> <tree_height> <updates> [base_port]"
+                  << " [--spawn] [--host0 H] [--host1 H] [--threads T]\n"
+                  << "Server b's shard_coord listens on base_port + b * (shards + 1).\n";
+        return 1;
+    }
+    uint64_t shards = std::stoull(pos[0]);
+    uint32_t vector_dim = static_cast<uint32_t>(std::stoul(pos[1]));
+    uint32_t tree_height = static_cast<uint32_t>(std::stoul(pos[2]));
+    uint64_t updates = std::stoull(pos[3]);
+    uint16_t base_port = pos.size() > 4 ? static_cast<uint16_t>(std::stoul(pos[4])) : 9100;
+
+    uint32_t split = shards > 1 ? 64 - __builtin_clzll(shards - 1) : 0;
+    if (shards == 0 || (1ULL << split) != shards || split > tree_height) {
+        std::cerr << "Shard count must be a power of two <= 2^tree_height.\n";
+        return 1;
+    }
+    uint64_t domain_size = domain_size_from_height(tree_height);
+    uint16_t ports[2] = {base_port, static_cast<uint16_t>(base_port + shards + 1)};
+
+    std::vector<pid_t> pids;
+    bool ok = true;
+    try {
+        if (spawn) {
+            for (int b = 0; b < 2; ++b)
+                pids.push_back(spawn_sibling("shard_coord",
+                                             {std::to_string(ports[b]), std::to_string(shards),
+                                              std::to_string(vector_dim), std::to_string(tree_height), "--spawn",
+                                              "--threads", std::to_string(shard_threads)}));
+        }
+
+        boost::asio::io_context io;
+        tcp::socket socks[2] = {connect_retry(io, hosts[0], ports[0]), connect_retry(io, hosts[1], ports[1])};
+
+        // Updates with random targets and payloads; FCW_m = M - r as after the
+        // servers' exchange
+        std::vector<std::vector<uint8_t>> keys[2];
+        std::map<uint64_t, std::vector<uint64_t>> expected;
+        uint64_t expected_sum = 0;
+        for (uint64_t u = 0; u < updates; ++u) {
+            uint64_t j = csprng().next_u64() % domain_size;
+            auto kp = Gen_point_zero(j, tree_height, vector_dim);
+            std::vector<FieldT> FCW_m(vector_dim);
+            auto& want = expected[j];
+            want.resize(vector_dim);
+            for (uint32_t d = 0; d < vector_dim; ++d) {
+                uint64_t M = csprng().next_u64() % 2001 - 1000;
+                FCW_m[d] = (FieldT)(M - (uint64_t)kp.first.fcw[d] - (uint64_t)kp.second.fcw[d]);
+                want[d] += M;
+                expected_sum += M;
+            }
+            kp.first.fcw = FCW_m;
+            kp.second.fcw = FCW_m;
+            keys[0].push_back(kp.first.serialize());
+            keys[1].push_back(kp.second.serialize());
+        }
+
+        // Both servers apply their keys concurrently; per server one thread
+        // streams the keys while another collects the acks
+        using clock = std::chrono::steady_clock;
+        auto t_start = clock::now();
+        std::vector<std::thread> workers;
+        char server_ok[2] = {1, 1};
+        for (int b = 0; b < 2; ++b) {
+            workers.emplace_back([&, b] {
+                try {
+                    std::thread writer([&] {
+                        for (const auto& k : keys[b]) send_frame(socks[b], SHARD_UPDATE, k);
+                    });
+                    for (uint64_t u = 0; u < updates; ++u) {
+                        Frame f = recv_frame(socks[b]);
+                        if (f.op != SHARD_ACK || f.payload.size() != 8 || get_u64(f.payload.data()) != u + 1)
+                            server_ok[b] = 0;
+                    }
+                    writer.join();
+                } catch (const std::exception& e) {
+                    std::cerr << "[server " << b << "] " << e.what() << "\n";
+                    server_ok[b] = 0;
+                }
+            });
+        }
+        for (auto& w : workers) w.join();
+        auto t_done = clock::now();
+        ok = server_ok[0] && server_ok[1];
+
+        // Check: the two servers' words sum to the sum of all payloads, and
+        // each updated item reconstructs to its payloads' sum
+        uint64_t sum = 0;
+        for (int b = 0; b < 2 && ok; ++b) {
+            send_frame(socks[b], SHARD_SUM);
+            Frame f = recv_frame(socks[b]);
+            if (f.op != SHARD_ACK || f.payload.size() != 8)
+                throw std::runtime_error("server " + std::to_string(b) + " sent a bad reply to SUM");
+            sum += get_u64(f.payload.data());
+        }
+        if (sum != expected_sum) ok = false;
+        for (const auto& [j, want] : expected) {
+            if (!ok) break;
+            std::vector<uint8_t> q;
+            put_u64(q, j);
+            Frame f[2];
+            for (int b = 0; b < 2; ++b) {
+                send_frame(socks[b], SHARD_GET, q);
+                f[b] = recv_frame(socks[b]);
+                if (f[b].op != SHARD_ACK || f[b].payload.size() != 8ULL * vector_dim)
+                    throw std::runtime_error("server " + std::to_string(b) + " sent a bad reply to GET " +
+                                             std::to_string(j));
+            }
+            for (uint32_t d = 0; d < vector_dim; ++d)
+                if (get_u64(&f[0].payload[8 * d]) + get_u64(&f[1].payload[8 * d]) != want[d]) ok = false;
+        }
+        for (auto& s : socks) send_frame(s, SHARD_QUIT);
+
+        double total = std::chrono::duration<double, std::milli>(t_done - t_start).count();
+        std::cout << "shards,N,vector_dim,updates,total_ms,items_per_s,match\n"
+                  << shards << "," << domain_size << "," << vector_dim << "," << updates << "," << total << ","
+                  << (double)domain_size * updates * 1e3 / total << "," << (ok ? "yes" : "NO") << "\n";
+    } catch (const std::exception& e) {
+        std::cerr << "[driver] " << e.what() << "\n";
+        ok = false;
+    }
+
+    for (pid_t pid : pids) {
+        int status;
+        if (!ok) kill(pid, SIGTERM);
+        waitpid(pid, &status, 0);
+    }
+    return ok ? 0 : 1;
+}
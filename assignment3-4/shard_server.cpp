@@ -0,0 +1,84 @@
+// One shard of one server's prefix-sharded item store: owns items
+// [p * N/S, (p + 1) * N/S) of that server's share array V_b, which is the
+// subtree of the DPF tree under prefix p, and applies the subtree keys of
+// k_b (SplitKey) that the server's shard_coord forwards to it. A shard never
+// sees the other server's share or keys.
+#include "dpf.h"
+#include "net.hpp"
+#include "thread_pool.hpp"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstring>
+
+using namespace cs670;
+
+int main(int argc, char** argv) {
+    std::vector<std::string> pos;
+    std::string bind = "127.0.0.1";
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        if (a == "--bind" && i + 1 < argc) bind = argv[++i];
+        else pos.push_back(a);
+    }
+    if (pos.size() < 5) {
+        std::cerr << "Usage: " << argv[0] << " <port> <shard> <shards> <vector_dim> <tree_height> [threads]"
+                  << " [--bind ADDR]\n";
+        return 1;
+    }
+    uint16_t port = static_cast<uint16_t>(std::stoul(pos[0]));
+    uint64_t shard = std::stoull(pos[1]);
+    uint64_t shards = std::stoull(pos[2]);
+    uint32_t vector_dim = static_cast<uint32_t>(std::stoul(pos[3]));
+    uint32_t tree_height = static_cast<uint32_t>(std::stoul(pos[4]));
+    unsigned threads = pos.size() > 5 ? static_cast<unsigned>(std::stoul(pos[5])) : 1;
+
+    uint32_t split = shards > 1 ? 64 - __builtin_clzll(shards - 1) : 0;
+    if ((1ULL << split) != shards || split > tree_height || shard >= shards || vector_dim == 0) {
+        std::cerr << "Shard count must be a power of two <= 2^tree_height, shard < shards.\n";
+        return 1;
+    }
+    uint32_t sub_height = tree_height - split;
+    uint64_t items = domain_size_from_height(sub_height);
+
+    std::vector<FieldT> V(items * vector_dim, 0);
+    WorkStealingPool pool(threads);
+
+    try {
+        boost::asio::io_context io;
+        tcp::acceptor acceptor(io, {boost::asio::ip::make_address(bind), port});
+        tcp::socket sock = acceptor.accept();
+        sock.set_option(tcp::no_delay(true));
+
+        uint64_t applied = 0;
+        for (;;) {
+            Frame f = recv_frame(sock);
+            std::vector<uint8_t> reply;
+            if (f.op == SHARD_UPDATE) {
+                DPFKey k = DPFKey::deserialize(f.payload);
+                if (k.tree_height != sub_height || k.fcw.size() != vector_dim)
+                    throw std::runtime_error("subtree key does not match this shard");
+                EvalFullAccumulate(k, V, 1, pool);
+                put_u64(reply, ++applied);
+            } else if (f.op == SHARD_SUM) {
+                uint64_t sum = 0;
+                for (FieldT v : V) sum += (uint64_t)v;
+                put_u64(reply, sum);
+            } else if (f.op == SHARD_GET && f.payload.size() == 8) {
+                uint64_t x = get_u64(f.payload.data());
+                if (x >= items) throw std::runtime_error("item outside this shard");
+                for (uint32_t d = 0; d < vector_dim; d++) put_u64(reply, (uint64_t)V[x * vector_dim + d]);
+            } else if (f.op == SHARD_QUIT) {
+                break;
+            } else {
+                throw std::runtime_error("unknown op " + std::to_string(f.op));
+            }
+            send_frame(sock, SHARD_ACK, reply);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "[shard " << shard << "] " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,7 +1,6 @@
 #include "dpf.h"
 #include <iostream>
 #include <fstream>
-#include <random>
 #include <string>
 
 using namespace cs670;
@@ -23,10 +22,7 @@ int main(int argc, char** argv) {
     uint32_t vector_dim = static_cast<uint32_t>(std::stoul(argv[3]));
     std::string out_prefix = argv[4];
 
-    std::random_device rd;
-    std::mt19937_64 rng(rd());
-
-    auto keys = Gen_point_zero(idx, tree_height, vector_dim, rng);
+    auto keys = Gen_point_zero(idx, tree_height, vector_dim);
     DPFKey k0 = keys.first;
     DPFKey k1 = keys.second;
 
@@ -0,0 +1,362 @@
+#pragma once
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(__AES__) && defined(__SSE2__)
+#include <wmmintrin.h>
+#include <emmintrin.h>
+#define CSPRNG_HAVE_AESNI 1
+#endif
+
+// AES-128 encryption under one expanded key. Uses AES-NI when built with
+// -maes, otherwise a portable byte-oriented implementation with the same output.
+class Aes128 {
+public:
+    Aes128() = default;
+    explicit Aes128(const unsigned char key[16]) { expand_key(key); }
+
+    void set_key(const unsigned char key[16]) { expand_key(key); }
+
+    // out[i] = AES_K(in[i]) for `blocks` 16-byte blocks; in may equal out
+    void encrypt(const unsigned char* in, unsigned char* out, size_t blocks) const;
+
+    // out[i] = AES_K(ctr + i), each counter block being the 64-bit
+    // little-endian counter followed by 8 zero bytes
+    void encrypt_ctr(uint64_t ctr, unsigned char* out, size_t blocks) const;
+
+private:
+#ifdef CSPRNG_HAVE_AESNI
+    static __m128i key_step(__m128i key, __m128i gen) {
+        gen = _mm_shuffle_epi32(gen, 0xff);
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+        return _mm_xor_si128(key, gen);
+    }
+
+    void expand_key(const unsigned char* key) {
+        rk_[0] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(key));
+        rk_[1] = key_step(rk_[0], _mm_aeskeygenassist_si128(rk_[0], 0x01));
+        rk_[2] = key_step(rk_[1], _mm_aeskeygenassist_si128(rk_[1], 0x02));
+        rk_[3] = key_step(rk_[2], _mm_aeskeygenassist_si128(rk_[2], 0x04));
+        rk_[4] = key_step(rk_[3], _mm_aeskeygenassist_si128(rk_[3], 0x08));
+        rk_[5] = key_step(rk_[4], _mm_aeskeygenassist_si128(rk_[4], 0x10));
+        rk_[6] = key_step(rk_[5], _mm_aeskeygenassist_si128(rk_[5], 0x20));
+        rk_[7] = key_step(rk_[6], _mm_aeskeygenassist_si128(rk_[6], 0x40));
+        rk_[8] = key_step(rk_[7], _mm_aeskeygenassist_si128(rk_[7], 0x80));
+        rk_[9] = key_step(rk_[8], _mm_aeskeygenassist_si128(rk_[8], 0x1b));
+        rk_[10] = key_step(rk_[9], _mm_aeskeygenassist_si128(rk_[9], 0x36));
+    }
+
+    // load(i) returns input block i; 8 blocks per pass keep the AES pipeline full
+    template <class Load>
+    void run(size_t blocks, unsigned char* out, Load load) const {
+        size_t i = 0;
+        for (; i + 8 <= blocks; i += 8) {
+            __m128i b[8];
+#pragma GCC unroll 8
+            for (int k = 0; k < 8; ++k) b[k] = _mm_xor_si128(load(i + k), rk_[0]);
+            for (int r = 1; r < 10; ++r) {
+#pragma GCC unroll 8
+                for (int k = 0; k < 8; ++k) b[k] = _mm_aesenc_si128(b[k], rk_[r]);
+            }
+#pragma GCC unroll 8
+            for (int k = 0; k < 8; ++k) {
+                b[k] = _mm_aesenclast_si128(b[k], rk_[10]);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * (i + k)), b[k]);
+            }
+        }
+        for (unsigned char* p = out + 16 * i; i < blocks; ++i, p += 16) {
+            __m128i b = _mm_xor_si128(load(i), rk_[0]);
+            for (int r = 1; r < 10; ++r) b = _mm_aesenc_si128(b, rk_[r]);
+            b = _mm_aesenclast_si128(b, rk_[10]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(p), b);
+        }
+    }
+
+    __m128i rk_[11];
+#else
+    static unsigned char sbox(unsigned char x) {
+        static const unsigned char S[256] = {
+            0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+            0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+            0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+            0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+            0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+            0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+            0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+            0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+            0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+            0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+            0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+            0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+            0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+            0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+            0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+            0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16};
+        return S[x];
+    }
+
+    static unsigned char xtime(unsigned char x) {
+        return static_cast<unsigned char>((x << 1) ^ ((x >> 7) * 0x1b));
+    }
+
+    void expand_key(const unsigned char* key) {
+        static const unsigned char rcon[10] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36};
+        std::memcpy(rk_, key, 16);
+        for (int i = 4; i < 44; ++i) {
+            unsigned char t[4];
+            std::memcpy(t, rk_ + 4 * (i - 1), 4);
+            if (i % 4 == 0) {
+                unsigned char t0 = t[0];
+                t[0] = static_cast<unsigned char>(sbox(t[1]) ^ rcon[i / 4 - 1]);
+                t[1] = sbox(t[2]);
+                t[2] = sbox(t[3]);
+                t[3] = sbox(t0);
+            }
+            for (int j = 0; j < 4; ++j) rk_[4 * i + j] = rk_[4 * (i - 4) + j] ^ t[j];
+        }
+    }
+
+    void encrypt_block(unsigned char* s) const {
+        for (int j = 0; j < 16; ++j) s[j] ^= rk_[j];
+        for (int r = 1; r <= 10; ++r) {
+            unsigned char t[16];
+            // SubBytes + ShiftRows
+            for (int c = 0; c < 4; ++c) {
+                for (int row = 0; row < 4; ++row) t[4 * c + row] = sbox(s[4 * ((c + row) % 4) + row]);
+            }
+            // MixColumns, skipped in the last round
+            if (r < 10) {
+                for (int c = 0; c < 4; ++c) {
+                    unsigned char* col = t + 4 * c;
+                    unsigned char a = col[0] ^ col[1] ^ col[2] ^ col[3], c0 = col[0];
+                    col[0] ^= a ^ xtime(col[0] ^ col[1]);
+                    col[1] ^= a ^ xtime(col[1] ^ col[2]);
+                    col[2] ^= a ^ xtime(col[2] ^ col[3]);
+                    col[3] ^= a ^ xtime(col[3] ^ c0);
+                }
+            }
+            for (int j = 0; j < 16; ++j) s[j] = t[j] ^ rk_[16 * r + j];
+        }
+    }
+
+    // load(i, block) writes input block i
+    template <class Load>
+    void run(size_t blocks, unsigned char* out, Load load) const {
+        for (size_t i = 0; i < blocks; ++i) {
+            unsigned char b[16];
+            load(i, b);
+            encrypt_block(b);
+            std::memcpy(out + 16 * i, b, 16);
+        }
+    }
+
+    unsigned char rk_[176];
+#endif
+};
+
+#ifdef CSPRNG_HAVE_AESNI
+inline void Aes128::encrypt(const unsigned char* in, unsigned char* out, size_t blocks) const {
+    run(blocks, out, [in](size_t i) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 16 * i)); });
+}
+
+inline void Aes128::encrypt_ctr(uint64_t ctr, unsigned char* out, size_t blocks) const {
+    run(blocks, out, [ctr](size_t i) { return _mm_set_epi64x(0, (long long)(ctr + i)); });
+}
+#else
+inline void Aes128::encrypt(const unsigned char* in, unsigned char* out, size_t blocks) const {
+    run(blocks, out, [in](size_t i, unsigned char* b) { std::memcpy(b, in + 16 * i, 16); });
+}
+
+inline void Aes128::encrypt_ctr(uint64_t ctr, unsigned char* out, size_t blocks) const {
+    run(blocks, out, [ctr](size_t i, unsigned char* b) {
+        uint64_t c = ctr + i;
+        for (int j = 0; j < 8; ++j) b[j] = static_cast<unsigned char>(c >> (8 * j));
+        std::memset(b + 8, 0, 8);
+    });
+}
+#endif
+
+// Seekable AES-128-CTR keystream: stream byte i is byte i % 16 of
+// AES_K(i / 16) (counter blocks as in encrypt_ctr). Any range can be produced
+// on its own, e.g. by different threads, and matches a sequential read;
+// whole blocks go through the 8-block AES pipeline straight into the output.
+class CtrPrg {
+public:
+    explicit CtrPrg(const unsigned char key[16]) : aes_(key) {}
+
+    // Position of the next sequential read, in bytes
+    void seek(uint64_t offset) { pos_ = offset; }
+    uint64_t tell() const { return pos_; }
+
+    // Stream bytes [offset, offset + n)
+    void fill_bytes_at(void* dst, size_t n, uint64_t offset) const {
+        unsigned char* out = static_cast<unsigned char*>(dst);
+        unsigned char blk[16];
+        size_t skip = offset % 16;
+        uint64_t ctr = offset / 16;
+        if (skip != 0 && n > 0) {
+            aes_.encrypt_ctr(ctr++, blk, 1);
+            size_t take = n < 16 - skip ? n : 16 - skip;
+            std::memcpy(out, blk + skip, take);
+            out += take;
+            n -= take;
+        }
+        size_t whole = n / 16;
+        aes_.encrypt_ctr(ctr, out, whole);
+        if (n % 16 != 0) {
+            aes_.encrypt_ctr(ctr + whole, blk, 1);
+            std::memcpy(out + 16 * whole, blk, n % 16);
+        }
+    }
+
+    // Elements [offset, offset + out.size()) of the stream read as T
+    template <class T>
+    void fill(std::span<T> out, uint64_t offset) const {
+        static_assert(std::is_trivially_copyable_v<T>, "fill needs trivially copyable elements");
+        fill_bytes_at(out.data(), out.size_bytes(), offset * sizeof(T));
+    }
+
+    // Sequential read from tell()
+    template <class T>
+    void fill(std::span<T> out) {
+        static_assert(std::is_trivially_copyable_v<T>, "fill needs trivially copyable elements");
+        fill_bytes_at(out.data(), out.size_bytes(), pos_);
+        pos_ += out.size_bytes();
+    }
+
+private:
+    Aes128 aes_;
+    uint64_t pos_ = 0;
+};
+
+// Buffered AES-128-CTR CSPRNG. Each thread gets its own generator through
+// csprng(), keyed from the OS entropy source (getentropy) on first use and
+// again whenever the process id changes, so a forked child never replays its
+// parent's stream. Small requests are served from a 16 KiB keystream buffer;
+// large fill()s write the keystream straight into the destination, 8 blocks
+// per AES pipeline pass.
+class Csprng {
+public:
+    using result_type = uint64_t;
+
+    Csprng() { reseed(); }
+
+    // Deterministic stream under a fixed key, for reproducible runs and tests
+    explicit Csprng(const unsigned char key[16]) { set_key(key); }
+
+    Csprng(const Csprng&) = delete;
+    Csprng& operator=(const Csprng&) = delete;
+
+    void reseed() {
+        unsigned char key[16];
+        if (::getentropy(key, sizeof(key)) != 0) throw std::runtime_error("getentropy failed");
+        set_key(key);
+        std::memset(key, 0, sizeof(key));
+        pid_ = ::getpid();
+    }
+
+    void fill_bytes(void* dst, size_t n) {
+        unsigned char* out = static_cast<unsigned char*>(dst);
+        check_fork();
+        size_t take = n < BUF_BYTES - pos_ ? n : BUF_BYTES - pos_;
+        consume(out, take);
+        out += take;
+        n -= take;
+        // Whole blocks go straight to the destination
+        size_t direct = n / 16;
+        if (direct > 0) {
+            keystream(out, direct);
+            out += 16 * direct;
+            n -= 16 * direct;
+        }
+        if (n > 0) {
+            refill();
+            consume(out, n);
+        }
+    }
+
+    template <class T>
+    void fill(std::span<T> out) {
+        static_assert(std::is_trivially_copyable_v<T>, "fill needs trivially copyable elements");
+        fill_bytes(out.data(), out.size_bytes());
+    }
+
+    template <class T>
+    T next() {
+        static_assert(std::is_trivially_copyable_v<T>, "next needs a trivially copyable type");
+        T x;
+        fill_bytes(&x, sizeof(x));
+        return x;
+    }
+
+    uint64_t next_u64() { return next<uint64_t>(); }
+    uint32_t next_u32() { return next<uint32_t>(); }
+
+    // Uniform in [0, bound) by rejection, bound > 0
+    uint64_t uniform(uint64_t bound) {
+        uint64_t limit = std::numeric_limits<uint64_t>::max() - std::numeric_limits<uint64_t>::max() % bound;
+        uint64_t x;
+        do {
+            x = next_u64();
+        } while (x >= limit);
+        return x % bound;
+    }
+
+    // UniformRandomBitGenerator, so the <random> distributions accept it
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    result_type operator()() { return next_u64(); }
+
+private:
+    static constexpr size_t BUF_BYTES = 16384;
+
+    void set_key(const unsigned char key[16]) {
+        aes_.set_key(key);
+        ctr_ = 0;
+        pos_ = BUF_BYTES;
+        pid_ = -1;
+    }
+
+    void check_fork() {
+        if (pid_ != -1 && pid_ != ::getpid()) reseed();
+    }
+
+    // Copies n buffered bytes (n <= BUF_BYTES - pos_) and wipes them
+    void consume(unsigned char* out, size_t n) {
+        std::memcpy(out, buf_ + pos_, n);
+        std::memset(buf_ + pos_, 0, n);
+        pos_ += n;
+    }
+
+    void refill() {
+        keystream(buf_, BUF_BYTES / 16);
+        pos_ = 0;
+    }
+
+    void keystream(unsigned char* out, size_t blocks) {
+        aes_.encrypt_ctr(ctr_, out, blocks);
+        ctr_ += blocks;
+    }
+
+    Aes128 aes_;
+    alignas(64) unsigned char buf_[BUF_BYTES];
+    size_t pos_ = BUF_BYTES;
+    uint64_t ctr_ = 0;
+    pid_t pid_ = -1;
+};
+
+// The calling thread's generator
+inline Csprng& csprng() {
+    thread_local Csprng g;
+    return g;
+}
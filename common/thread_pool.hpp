@@ -0,0 +1,118 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads. run() deals task ids 0..n-1 round-robin
+// onto per-worker deques; each worker pops from the back of its own deque and,
+// once that is empty, steals from the front of the others. The calling thread
+// takes part as worker 0, so a pool of size 1 spawns no threads.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(unsigned num_threads) {
+        if (num_threads == 0) num_threads = 1;
+        for (unsigned i = 0; i < num_threads; ++i) queues_.push_back(std::make_unique<Queue>());
+        for (unsigned i = 1; i < num_threads; ++i) threads_.emplace_back([this, i] { worker_loop(i); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            stop_ = true;
+        }
+        cv_start_.notify_all();
+        for (auto& th : threads_) th.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(queues_.size()); }
+
+    // Runs fn(task) for every task in [0, num_tasks) and returns when all are done.
+    // fn must not throw.
+    void run(size_t num_tasks, const std::function<void(size_t)>& fn) {
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            for (size_t i = 0; i < num_tasks; ++i) {
+                queues_[i % queues_.size()]->q.push_back(i);
+            }
+            fn_ = &fn;
+            active_ = static_cast<unsigned>(threads_.size());
+            ++generation_;
+        }
+        cv_start_.notify_all();
+        drain(0, fn);
+        std::unique_lock<std::mutex> lk(m_);
+        cv_done_.wait(lk, [this] { return active_ == 0; });
+        fn_ = nullptr;
+    }
+
+private:
+    struct Queue {
+        std::mutex m;
+        std::deque<size_t> q;
+    };
+
+    bool pop_or_steal(unsigned self, size_t& task) {
+        {
+            Queue& own = *queues_[self];
+            std::lock_guard<std::mutex> lk(own.m);
+            if (!own.q.empty()) {
+                task = own.q.back();
+                own.q.pop_back();
+                return true;
+            }
+        }
+        for (size_t k = 1; k < queues_.size(); ++k) {
+            Queue& victim = *queues_[(self + k) % queues_.size()];
+            std::lock_guard<std::mutex> lk(victim.m);
+            if (!victim.q.empty()) {
+                task = victim.q.front();
+                victim.q.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // All tasks are queued before workers start, so one empty sweep means done
+    void drain(unsigned self, const std::function<void(size_t)>& fn) {
+        size_t task;
+        while (pop_or_steal(self, task)) fn(task);
+    }
+
+    void worker_loop(unsigned id) {
+        uint64_t seen = 0;
+        for (;;) {
+            const std::function<void(size_t)>* fn;
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                cv_start_.wait(lk, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+                fn = fn_;
+            }
+            drain(id, *fn);
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                if (--active_ == 0) cv_done_.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::mutex m_;
+    std::condition_variable cv_start_, cv_done_;
+    const std::function<void(size_t)>* fn_ = nullptr;
+    uint64_t generation_ = 0;
+    unsigned active_ = 0;
+    bool stop_ = false;
+};